@@ -0,0 +1,897 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "p4_vm.h"
+#include "p4_aot.h"
+
+/* Ahead-of-time translation.
+ ==========================
+ p4_aot writes the program loaded by p4_assembler as a C translation unit with
+ one function per procedure, called with the data segment of its frame. The
+ procedures are found from the bootstrap code at address 0 following the cup
+ instructions, and the static level of each one from the mst of its calls, so
+ display entries are constants. The depth of the stack is the same at every
+ visit of an address, so it is computed once and the cells above the data
+ segment are held in locals x0, x1 ... of the function. They are written to the
+ store only where the store is read: the parameters of a cup and the arguments
+ of a csp. ujp and fjp become gotos and xjp a switch over its jump table.
+ Computed addresses are checked against the store as in the interpreter
+ (VMFAULT). The standard procedures run through p4_vm_callsp, so the
+ translation is built with the vm:
+
+     cc -O2 -Ip4_vm -Ip4_asm_comp prog.c p4_vm/p4_vm.c \
+        p4_vm/p4_heap.c p4_vm/p4_jit.c p4_asm_comp/p4_file.c -lm
+
+ The program reads prd from its first argument and writes prr to its second
+ (default: its own name followed by .p4).
+ */
+
+// procedure to translate
+typedef struct aot_proc_s {
+    uint32_t entry;       // address of ent (0 for the bootstrap code)
+    uint32_t first, last; // addresses reached from entry
+     int32_t lv;          // static level
+     int32_t data;        // cells of the data segment, the stack starts above
+     int32_t cells;       // locals holding the stack
+} aot_proc_t;
+
+typedef struct aot_s {
+       p4_vm_t p4vm;
+          FILE *f;
+       int16_t *depth; // cells on the stack before each address, -1 if not reached
+      uint32_t *owner; // entry of the procedure each reached address belongs to
+          bool *label; // address is a jump target
+       int32_t *index; // procedure entered at each address, -1 if none
+    aot_proc_t *proc;  // one per entry, an address at most
+      uint32_t nproc;
+} aot_t;
+
+// cells taken from the stack by each standard procedure, 0 if it replaces its argument
+static const int8_t cspop[23] = { 1, 1, 1, 1, 2, 1, 4, 0, 3, 3, 3, 2, 2, 2, 0, 0, 0, 0, 0, 0, 1, 2, 1 };
+
+static void fetch(p4_vm_t p4vm, uint32_t pc, uint8_t *op, uint8_t *p, int32_t *q) {
+    rec_code_t *WITH = &(p4vm->code[pc / 2]);
+
+    if (pc & 1) {
+        *op = WITH->op2;
+        *p = WITH->p2;
+        *q = WITH->q2;
+    } else {
+        *op = WITH->op1;
+        *p = WITH->p1;
+        *q = WITH->q1;
+    }
+} // fetch
+
+static void out(aot_t *a, const char *fmt, ...) {
+    va_list ap;
+
+    if (*fmt != '\0')
+        fputs("    ", a->f);
+    va_start(ap, fmt);
+    vfprintf(a->f, fmt, ap);
+    va_end(ap);
+    fputc('\n', a->f);
+} // out
+
+// "b + k" written for C
+static const char* at(char *buf, const char *b, int32_t k) {
+    if (k == 0)
+        sprintf(buf, "%s", b);
+    else
+        sprintf(buf, "%s %c %d", b, (k < 0) ? '-' : '+', abs(k));
+    return buf;
+} // at
+
+// a function leaves its result on the stack (its first ret)
+static bool result(p4_vm_t p4vm, uint32_t entry) {
+    uint32_t pc;
+    uint8_t op, p;
+    int32_t q;
+
+    for (pc = entry; pc < p4vm->codelen; pc++) {
+        fetch(p4vm, pc, &op, &p, &q);
+        if (op == 14)
+            return p != 0;
+    }
+    return false;
+} // result
+
+static int32_t effect(p4_vm_t p4vm, uint8_t op, uint8_t p, int32_t q) {
+    switch (op) {
+        case 0:
+        case 1:
+        case 4:
+        case 5:
+        case 7:
+        case 8:
+        case 56:
+        case 65 ... 69:
+        case 105 ... 109:
+            return 1;
+
+        case 2:
+        case 3:
+        case 16:
+        case 62:
+        case 17 ... 22:
+        case 24:
+        case 25:
+        case 28 ... 31:
+        case 43 ... 49:
+        case 51 ... 54:
+        case 70 ... 79:
+            return -1;
+
+        case 6:
+        case 55:
+        case 64:
+        case 80 ... 84:
+            return -2;
+
+        case 11: // mst
+            return 5;
+
+        case 12: // cup
+            return -(p + 5) + result(p4vm, q);
+
+        case 15: // csp
+            return (q >= 0 && q <= 22) ? -cspop[q] : 0;
+    }
+    return 0;
+} // effect
+
+static bool reach(aot_t *a, aot_proc_t *P, uint32_t *work, uint32_t *n, uint32_t pc, int32_t d, bool jump) {
+    if (pc >= a->p4vm->codelen)
+        return false;
+    if (jump)
+        a->label[pc] = true;
+    if (a->depth[pc] >= 0)
+        return a->depth[pc] == d && a->owner[pc] == P->entry;
+
+    a->depth[pc] = d;
+    a->owner[pc] = P->entry;
+    if (pc < P->first)
+        P->first = pc;
+    if (pc > P->last)
+        P->last = pc;
+    work[(*n)++] = pc;
+    return true;
+} // reach
+
+// depth of the stack at each address of a procedure
+static bool analyse(aot_t *a, aot_proc_t *P) {
+    uint32_t *work = malloc((a->p4vm->codelen + 1) * sizeof(uint32_t));
+    uint32_t n = 0, pc, k;
+    int32_t d;
+    uint8_t op, p, kop, kp;
+    int32_t q, kq;
+    bool ok;
+
+    P->first = P->last = P->entry;
+    P->cells = 0;
+    ok = reach(a, P, work, &n, P->entry, 0, false);
+    while (ok && n > 0) {
+        pc = work[--n];
+        fetch(a->p4vm, pc, &op, &p, &q);
+        if (op == 13 && p == 1)
+            d = 0;
+        else
+            d = a->depth[pc] + effect(a->p4vm, op, p, q);
+        if (d < 0 || d >= AOTDEPTH) {
+            ok = false;
+            break;
+        }
+        if (d > P->cells)
+            P->cells = d;
+
+        switch (op) {
+            case 23: // ujp
+                ok = reach(a, P, work, &n, q, d, true);
+                break;
+
+            case 24: // fjp
+                ok = reach(a, P, work, &n, pc + 1, d, false) && reach(a, P, work, &n, q, d, true);
+                break;
+
+            case 25: // xjp, the table is a run of ujp and ujc
+                for (k = q; ok && k < a->p4vm->codelen; k++) {
+                    fetch(a->p4vm, k, &kop, &kp, &kq);
+                    if (kop == 23)
+                        ok = reach(a, P, work, &n, kq, d, true);
+                    else if (kop != 61)
+                        break;
+                }
+                break;
+
+            case 14: // ret
+            case 58: // stp
+            case 61: // ujc
+                break;
+
+            default:
+                ok = reach(a, P, work, &n, pc + 1, d, false);
+        }
+    }
+    free(work);
+
+    return ok;
+} // analyse
+
+// levels of the procedures called from P
+static bool calls(aot_t *a, aot_proc_t *P) {
+    int8_t mst[AOTDEPTH];
+    aot_proc_t *C;
+    uint32_t pc;
+    int32_t d, lv;
+    uint8_t op, p;
+    int32_t q, data;
+
+    memset(mst, -1, sizeof(mst));
+    for (pc = P->first; pc <= P->last; pc++) {
+        if (a->depth[pc] < 0 || a->owner[pc] != P->entry)
+            continue;
+        d = a->depth[pc];
+        fetch(a->p4vm, pc, &op, &p, &q);
+        switch (op) {
+            case 0:
+            case 2:
+            case 4:
+            case 70 ... 74:
+            case 105 ... 109: // display entry
+                if (p > P->lv)
+                    return false;
+                break;
+
+            case 11: // mst
+                mst[d] = p;
+                break;
+
+            case 12: // cup
+                d -= p + 5;
+                if (d < 0 || mst[d] < 0)
+                    return false;
+                lv = P->lv + 1 - mst[d];
+                if (lv < 1 || lv >= DISPLAYMAX || q < 0 || q >= (int32_t) a->p4vm->codelen)
+                    return false;
+                if (a->index[q] >= 0) {
+                    if (a->proc[a->index[q]].lv != lv)
+                        return false;
+                    break;
+                }
+                fetch(a->p4vm, q, &op, &p, &data);
+                if (op != 13 || p != 1)
+                    return false;
+                a->index[q] = a->nproc;
+                C = &a->proc[a->nproc++];
+                C->entry = q;
+                C->lv = lv;
+                C->data = data;
+                break;
+        }
+    }
+
+    return true;
+} // calls
+
+// field moved by the typed variants of a load or store: integers and reals alone, the others whole cells
+static const char* field(uint8_t op, uint8_t plain, uint8_t typed) {
+    if (op == plain)
+        return ".vi";
+    if (op == typed + 1)
+        return ".vr";
+    return "";
+} // field
+
+// the address in local x, and the k cells from it, lie in the store (a negative k never does)
+static void inside(aot_t *a, int32_t x, int32_t k, bool never) {
+    if (never || k > MAXSTR(a->p4vm))
+        out(a, "stop(%d);", VMFAULT);
+    else {
+        out(a, "if ((uint32_t) x%d.va > %d)", x, MAXSTR(a->p4vm) - k);
+        out(a, "    stop(%d);", VMFAULT);
+    }
+} // inside
+
+static void compare(aot_t *a, uint8_t op, uint8_t p, int32_t q, int32_t n, int32_t t) {
+    static const char *const rel[6] = { "==", "!=", ">=", ">", "<=", "<" };
+    static const char *const fld[7] = { "va", "vi", "vr", "vb", "vs", "", "vc" };
+
+    op -= 17;
+    if (p == 0 && op >= 2) {
+        out(a, "stop(%d);", op + 17);
+        return;
+    }
+    switch (p) {
+        case 4: // sets
+            if (op <= 1)
+                out(a, "x%d.vb = (x%d.vs %s x%d.vs);", n, n, (op == 1) ? "!=" : "==", t);
+            else if (op == 2)
+                out(a, "x%d.vb = ((x%d.vs & ~x%d.vs) == 0);", n, t, n);
+            else if (op == 4)
+                out(a, "x%d.vb = ((x%d.vs & ~x%d.vs) == 0);", n, n, t);
+            else
+                out(a, "stop(%d);", op + 17);
+            break;
+
+        case 5: // strings of q chars at two addresses
+            inside(a, n, (q + CHARCELL - 1) / CHARCELL, q < 0);
+            inside(a, t, (q + CHARCELL - 1) / CHARCELL, q < 0);
+            out(a, "x%d.vb = (memcmp(&S[x%d.va], &S[x%d.va], %d) %s 0);", n, n, t, q, rel[op]);
+            break;
+
+        case 0 ... 3:
+        case 6:
+            out(a, "x%d.vb = (x%d.%s %s x%d.%s);", n, n, fld[p], rel[op], t, fld[p]);
+            break;
+
+        default:
+            out(a, "stop(%d);", op + 17);
+            break;
+    }
+} // compare
+
+static void translate(aot_t *a, aot_proc_t *P, uint32_t pc, uint8_t op, uint8_t p, int32_t q) {
+    p4_vm_t p4vm = a->p4vm;
+    int32_t d = a->depth[pc], t = d - 1, n = d - 2, k;
+    const char *f;
+    char b[32], c[64];
+    uint32_t e;
+    uint8_t eop, ep;
+    int32_t eq;
+
+    // data segment p levels out
+    if (p == 0)
+        strcpy(b, "mp");
+    else
+        sprintf(b, "vm->display[%d]", P->lv - p);
+
+    switch (op) {
+        case 0:
+        case 105 ... 109: // lod
+            f = field(op, 0, 105);
+            out(a, "x%d%s = S[%s]%s;", d, f, at(c, b, q), f);
+            break;
+
+        case 1:
+        case 65 ... 69: // ldo
+            f = field(op, 1, 65);
+            out(a, "x%d%s = S[%d]%s;", d, f, q, f);
+            break;
+
+        case 2:
+        case 70 ... 74: // str
+            f = field(op, 2, 70);
+            out(a, "S[%s]%s = x%d%s;", at(c, b, q), f, t, f);
+            break;
+
+        case 3:
+        case 75 ... 79: // sro
+            f = field(op, 3, 75);
+            out(a, "S[%d]%s = x%d%s;", q, f, t, f);
+            break;
+
+        case 4: // lda
+            out(a, "x%d.va = %s;", d, at(c, b, q));
+            break;
+
+        case 5: // lao
+        case 56: // lca
+            out(a, "x%d.va = %d;", d, q);
+            break;
+
+        case 6:
+        case 80 ... 84: // sto
+            f = field(op, 6, 80);
+            inside(a, n, 1, false);
+            out(a, "S[x%d.va]%s = x%d%s;", n, f, t, f);
+            break;
+
+        case 7: // ldc
+            if (p == 1)
+                out(a, "x%d.vi = %d;", d, q);
+            else if (p == 6)
+                out(a, "x%d.vc = %d;", d, q);
+            else if (p == 3)
+                out(a, "x%d.vb = %d;", d, q == 1);
+            else
+                out(a, "x%d.va = %d;", d, MAXSTR(p4vm));
+            break;
+
+        case 8: // lci
+            if (p == 1)
+                out(a, "x%d.vi = %d;", d, p4vm->store[q].vi);
+            else
+                out(a, "x%d = S[%d];", d, q);
+            break;
+
+        case 9:
+        case 85 ... 89: // ind
+            f = field(op, 9, 85);
+            out(a, "if ((uint32_t) x%d.va + %d >= %d)", t, q, MAXSTR(p4vm));
+            out(a, "    stop(%d);", VMFAULT);
+            out(a, "x%d%s = S[x%d.va + %d]%s;", t, f, t, q, f);
+            break;
+
+        case 10:
+        case 90 ... 94: // inc
+            out(a, "x%d.vi += %d;", t, q);
+            break;
+
+        case 57:
+        case 100 ... 104: // dec
+            out(a, "x%d.vi -= %d;", t, q);
+            break;
+
+        case 11: // mst, the frame is set up by the called function
+            break;
+
+        case 12: // cup
+            n = d - p - 5;
+            for (k = n + 5; k < d; k++)
+                out(a, "S[%s] = x%d;", at(c, "mp", P->data + 1 + k), k);
+            out(a, "p%d(%s);", q, at(c, "mp", P->data + 1 + n));
+            if (result(p4vm, q))
+                out(a, "x%d = S[%s];", n, at(c, "mp", P->data + 1 + n));
+            break;
+
+        case 13: // ent
+            // the ep of ent 2, right after ent 1, is above its data segment
+            if (p == 2) {
+                out(a, "vm->ep = %s;", at(c, "mp", P->data + q));
+                out(a, "if (vm->ep > vm->np)");
+                out(a, "    stop(%d);", op);
+            }
+            break;
+
+        case 14: // ret
+            out(a, "vm->display[%d] = dp;", P->lv);
+            out(a, "vm->ep = ep;");
+            out(a, "return;");
+            break;
+
+        case 15: // csp
+            n = (q >= 0 && q <= 22 && cspop[q] > 0) ? cspop[q] : 1;
+            for (k = d - n; k < d; k++)
+                out(a, "S[%s] = x%d;", at(c, "mp", P->data + 1 + k), k);
+            out(a, "csp(%s, %d);", at(c, "mp", P->data + d), q);
+            if (n == 1 && (q < 0 || q > 22 || cspop[q] == 0))
+                out(a, "x%d = S[%s];", t, at(c, "mp", P->data + d));
+            break;
+
+        case 16: // ixa
+            out(a, "x%d.va += %d * x%d.vi;", n, q, t);
+            break;
+
+        case 17 ... 22: // equ neq geq grt leq les
+            compare(a, op, p, q, n, t);
+            break;
+
+        case 23: // ujp
+            out(a, "goto L%d;", q);
+            break;
+
+        case 24: // fjp
+            out(a, "if (!x%d.vb)", t);
+            out(a, "    goto L%d;", q);
+            break;
+
+        case 25: // xjp
+            out(a, "switch (x%d.vi) {", t);
+            for (e = q; e < p4vm->codelen; e++) {
+                fetch(p4vm, e, &eop, &ep, &eq);
+                if (eop != 23 && eop != 61)
+                    break;
+                out(a, "    case %d:", e - q);
+                if (eop == 23)
+                    out(a, "        goto L%d;", eq);
+                else
+                    out(a, "        stop(61);");
+            }
+            out(a, "    default:");
+            out(a, "        stop(%d);", op);
+            out(a, "}");
+            break;
+
+        case 95: // chka
+            out(a, "if (x%d.va < vm->np || x%d.va > %d)", t, t, MAXSTR(p4vm) - q);
+            out(a, "    stop(%d);", op);
+            break;
+
+        case 26:
+        case 96 ... 99: // chk
+            out(a, "if (x%d.vi < %d || x%d.vi > %d)", t, p4vm->store[q - 1].vi, t, p4vm->store[q].vi);
+            out(a, "    stop(%d);", op);
+            break;
+
+        case 27: // eof
+            out(a, "if (x%d.vi != INPUTADR)", t);
+            out(a, "    stop(%d);", op);
+            out(a, "x%d.vb = p4_file_eof(vm->input.f);", t);
+            break;
+
+        case 28: // adi
+            out(a, "x%d.vi += x%d.vi;", n, t);
+            break;
+
+        case 29: // adr
+            out(a, "x%d.vr += x%d.vr;", n, t);
+            break;
+
+        case 30: // sbi
+            out(a, "x%d.vi -= x%d.vi;", n, t);
+            break;
+
+        case 31: // sbr
+            out(a, "x%d.vr -= x%d.vr;", n, t);
+            break;
+
+        case 32: // sgs
+            out(a, "if ((uint32_t) x%d.vi >= SETMAX)", t);
+            out(a, "    stop(%d);", op);
+            out(a, "x%d.vs = (setbits_t) 1 << x%d.vi;", t, t);
+            break;
+
+        case 33: // flt
+            out(a, "x%d.vr = x%d.vi;", t, t);
+            break;
+
+        case 34: // flo
+            out(a, "x%d.vr = x%d.vi;", n, n);
+            break;
+
+        case 35: // trc
+            out(a, "x%d.vi = (long) x%d.vr;", t, t);
+            break;
+
+        case 36: // ngi
+            out(a, "x%d.vi = -x%d.vi;", t, t);
+            break;
+
+        case 37: // ngr
+            out(a, "x%d.vr = -x%d.vr;", t, t);
+            break;
+
+        case 38: // sqi
+            out(a, "x%d.vi = (long) x%d.vi * x%d.vi;", t, t, t);
+            break;
+
+        case 39: // sqr
+            out(a, "x%d.vr = x%d.vr * x%d.vr;", t, t, t);
+            break;
+
+        case 40: // abi
+            out(a, "x%d.vi = labs(x%d.vi);", t, t);
+            break;
+
+        case 41: // abr
+            out(a, "x%d.vr = fabs(x%d.vr);", t, t);
+            break;
+
+        case 42: // not
+            out(a, "x%d.vb = !x%d.vb;", t, t);
+            break;
+
+        case 43: // and
+            out(a, "x%d.vb = (x%d.vb && x%d.vb);", n, n, t);
+            break;
+
+        case 44: // ior
+            out(a, "x%d.vb = (x%d.vb || x%d.vb);", n, n, t);
+            break;
+
+        case 45: // dif
+            out(a, "x%d.vs &= ~x%d.vs;", n, t);
+            break;
+
+        case 46: // int
+            out(a, "x%d.vs &= x%d.vs;", n, t);
+            break;
+
+        case 47: // uni
+            out(a, "x%d.vs |= x%d.vs;", n, t);
+            break;
+
+        case 48: // inn
+            out(a, "x%d.vb = ((uint32_t) x%d.vi < SETMAX && ((x%d.vs >> x%d.vi) & 1));", n, n, t, n);
+            break;
+
+        case 49: // mod
+            out(a, "x%d.vi %%= x%d.vi;", n, t);
+            break;
+
+        case 50: // odd
+            out(a, "x%d.vb = x%d.vi & 1;", t, t);
+            break;
+
+        case 51: // mpi
+            out(a, "x%d.vi *= x%d.vi;", n, t);
+            break;
+
+        case 52: // mpr
+            out(a, "x%d.vr *= x%d.vr;", n, t);
+            break;
+
+        case 53: // dvi
+            out(a, "x%d.vi /= x%d.vi;", n, t);
+            break;
+
+        case 54: // dvr
+            out(a, "x%d.vr /= x%d.vr;", n, t);
+            break;
+
+        case 55: // mov
+            inside(a, n, q, q < 0);
+            inside(a, t, q, q < 0);
+            out(a, "memmove(&S[x%d.va], &S[x%d.va], %d * sizeof(rec_store_t));", n, t, q);
+            break;
+
+        case 62: // ixb
+            out(a, "x%d.va = CHARADR(x%d.va, x%d.vi);", n, n, t);
+            break;
+
+        case 63: // ldb
+            out(a, "if ((uint32_t) x%d.va >= %d)", t, MAXSTR(p4vm) * CHARCELL);
+            out(a, "    stop(%d);", VMFAULT);
+            out(a, "x%d.vi = CHARS(vm)[x%d.va];", t, t);
+            break;
+
+        case 64: // stb
+            out(a, "if ((uint32_t) x%d.va >= %d)", n, MAXSTR(p4vm) * CHARCELL);
+            out(a, "    stop(%d);", VMFAULT);
+            out(a, "CHARS(vm)[x%d.va] = x%d.vc;", n, t);
+            break;
+
+        case 58: // stp
+            out(a, "stop(255);");
+            break;
+
+        case 59: // ord
+        case 60: // chr
+            break;
+
+        default: // ujc and undefined operations
+            out(a, "stop(%d);", op);
+    }
+} // translate
+
+// names the body of a function refers to: the store and the locals holding the stack
+static bool uses(const char *body, bool *cell) {
+    const char *c;
+    bool store = false;
+    long k;
+
+    memset(cell, 0, AOTDEPTH * sizeof(bool));
+    for (c = body; *c != '\0'; c++) {
+        if (c != body && (isalnum((unsigned char) c[-1]) || c[-1] == '_'))
+            continue;
+        if (c[0] == 'S' && c[1] == '[')
+            store = true;
+        else if (c[0] == 'x' && isdigit((unsigned char) c[1])) {
+            k = strtol(c + 1, (char**) &c, 10);
+            if (k < AOTDEPTH)
+                cell[k] = true;
+            c--;
+        }
+    }
+
+    return store;
+} // uses
+
+static bool procedure(aot_t *a, aot_proc_t *P) {
+    FILE *f = a->f;
+    char *body = NULL;
+    size_t len = 0;
+    bool cell[AOTDEPTH];
+    uint32_t pc;
+    int32_t k;
+    uint8_t op, p;
+    int32_t q;
+
+    // the body goes first to memory, to declare only what it uses
+    if ((a->f = open_memstream(&body, &len)) == NULL) {
+        a->f = f;
+        return false;
+    }
+    for (pc = P->first; pc <= P->last; pc++) {
+        if (a->depth[pc] < 0 || a->owner[pc] != P->entry)
+            continue;
+        if (a->label[pc])
+            fprintf(a->f, "L%u:;\n", pc);
+        fetch(a->p4vm, pc, &op, &p, &q);
+        translate(a, P, pc, op, p, q);
+    }
+    fclose(a->f);
+    a->f = f;
+
+    fprintf(a->f, "\nstatic void p%u(int32_t mp) {\n", P->entry);
+    if (uses(body, cell))
+        out(a, "rec_store_t *const S = vm->store;");
+    for (k = 0; k < P->cells; k++)
+        if (cell[k])
+            out(a, "rec_store_t x%d = { 0 };", k);
+    if (P->entry != 0) {
+        out(a, "int32_t ep = vm->ep, dp = vm->display[%d];", P->lv);
+        out(a, "");
+        out(a, "vm->display[%d] = mp;", P->lv);
+    }
+    fwrite(body, 1, len, a->f);
+    fprintf(a->f, "} // p%u\n", P->entry);
+    free(body);
+
+    return true;
+} // procedure
+
+static void runtime(aot_t *a, const char *name) {
+    rec_store_t *s;
+    uint32_t ad, k;
+    static const rec_store_t zero;
+
+    fprintf(a->f, "// P-code translated by p4 -aot, build with the vm:\n");
+    fprintf(a->f, "//     cc -O2 -Ip4_vm -Ip4_asm_comp %s p4_vm/p4_vm.c p4_vm/p4_heap.c p4_vm/p4_jit.c p4_asm_comp/p4_file.c -lm\n\n",
+            name);
+    fprintf(a->f, "#include <math.h>\n#include <setjmp.h>\n#include <stdint.h>\n#include <stdbool.h>\n#include <stdio.h>\n");
+    fprintf(a->f, "#include <stdlib.h>\n#include <string.h>\n\n");
+    fprintf(a->f, "#include \"p4_vm.h\"\n#include \"p4_file.h\"\n\n");
+    fprintf(a->f, "_Static_assert(sizeof(rec_store_t) == %u, \"translated for another store layout\");\n\n", (unsigned) sizeof(rec_store_t));
+
+    // constants placed by the assembler above the variable store
+    fprintf(a->f, "static const struct {\n    int32_t ad;\n    uint8_t v[%u];\n} image[] = {\n", (unsigned) sizeof(rec_store_t));
+    for (ad = a->p4vm->maxstk + 1; ad <= (uint32_t) OVERC(a->p4vm); ad++) {
+        s = &a->p4vm->store[ad];
+        if (memcmp(s, &zero, sizeof(rec_store_t)) == 0)
+            continue;
+        fprintf(a->f, "    { %u, {", ad);
+        for (k = 0; k < sizeof(rec_store_t); k++)
+            fprintf(a->f, "%s%u", (k == 0) ? " " : ", ", ((uint8_t*) s)[k]);
+        fprintf(a->f, " } },\n");
+    }
+    fprintf(a->f, "    { 0, { 0 } }\n};\n\n");
+
+    fprintf(a->f, "static p4_vm_t vm;\nstatic jmp_buf fail;\n\n");
+    fprintf(a->f, "static void stop(uint8_t op) {\n    longjmp(fail, op);\n} // stop\n\n");
+    fprintf(a->f, "static void csp(int32_t sp, int32_t q) {\n    uint8_t err;\n\n    vm->sp = sp;\n");
+    fprintf(a->f, "    if ((err = p4_vm_callsp(vm, q, 15)) != 255)\n        stop(err);\n} // csp\n\n");
+    for (k = 0; k < a->nproc; k++)
+        fprintf(a->f, "static void p%u(int32_t mp);\n", a->proc[k].entry);
+} // runtime
+
+static void driver(aot_t *a) {
+    fprintf(a->f, "\nint main(int argc, char *argv[]) {\n");
+    out(a, "char name[256];");
+    out(a, "uint8_t err;");
+    out(a, "int n;");
+    out(a, "");
+    out(a, "vm = calloc(1, P4_VM_SIZE(%d, %d));", a->p4vm->maxstk, a->p4vm->consts);
+    out(a, "vm->maxstk = %d;", a->p4vm->maxstk);
+    out(a, "vm->consts = %d;", a->p4vm->consts);
+    out(a, "for (n = 0; image[n].ad != 0; n++)");
+    out(a, "    memcpy(&vm->store[image[n].ad], image[n].v, sizeof(rec_store_t));");
+    out(a, "");
+    out(a, "snprintf(name, sizeof(name), \"%%s.p4\", argv[0]);");
+    out(a, "vm->input.f = stdin;");
+    out(a, "vm->output.f = stdout;");
+    out(a, "vm->prd.f = (argc > 1) ? fopen(argv[1], \"r\") : NULL;");
+    out(a, "vm->prr.f = fopen((argc > 2) ? argv[2] : name, \"w\");");
+    out(a, "if (vm->prr.f == NULL || (argc > 1 && vm->prd.f == NULL)) {");
+    out(a, "    printf(\"file not found\\n\");");
+    out(a, "    return 1;");
+    out(a, "}");
+    out(a, "");
+    out(a, "vm->pc = 0;");
+    out(a, "vm->sp = -1;");
+    out(a, "vm->mp = 0;");
+    out(a, "vm->np = vm->maxstk + 1;");
+    out(a, "vm->ep = 5;");
+    out(a, "vm->lv = 0;");
+    out(a, "vm->display[0] = 0;");
+    out(a, "vm->store[INPUTADR].vc = ' ';");
+    out(a, "if (vm->prd.f != NULL)");
+    out(a, "    vm->store[PRDADR].vc = p4_file_peek(vm->prd.f);");
+    out(a, "vm->run = true;");
+    out(a, "");
+    out(a, "if ((err = setjmp(fail)) == 0) {");
+    out(a, "    p0(0);");
+    out(a, "    err = 255;");
+    out(a, "}");
+    out(a, "if (err == VMFAULT)");
+    out(a, "    printf(\"ERROR: access outside the store\\n\");");
+    out(a, "else if (err != 255)");
+    out(a, "    printf(\"ERROR op: %%d\\n\", err);");
+    out(a, "");
+    out(a, "if (vm->prd.f != NULL)");
+    out(a, "    fclose(vm->prd.f);");
+    out(a, "fclose(vm->prr.f);");
+    out(a, "free(vm);");
+    out(a, "return 0;");
+    fprintf(a->f, "} // main\n");
+} // driver
+
+static void release(aot_t *a) {
+    free(a->depth);
+    free(a->owner);
+    free(a->label);
+    free(a->index);
+    free(a->proc);
+    free(a);
+} // release
+
+bool p4_aot(p4_vm_t p4vm, const char *name) {
+    aot_t *a = calloc(1, sizeof(aot_t));
+    uint32_t k, n = p4vm->codelen + 1;
+    bool ok = true;
+
+    if (a == NULL)
+        return false;
+    a->p4vm = p4vm;
+    a->depth = malloc(n * sizeof(int16_t));
+    a->owner = malloc(n * sizeof(uint32_t));
+    a->label = calloc(n, sizeof(bool));
+    a->index = malloc(n * sizeof(int32_t));
+    a->proc = malloc(n * sizeof(aot_proc_t));
+    if (a->depth == NULL || a->owner == NULL || a->label == NULL || a->index == NULL || a->proc == NULL) {
+        release(a);
+        return false;
+    }
+    memset(a->depth, -1, n * sizeof(int16_t));
+    memset(a->index, -1, n * sizeof(int32_t));
+
+    // the bootstrap code (mst, cup main, stp) runs at level 0 below the store
+    a->index[0] = 0;
+    a->proc[0].entry = 0;
+    a->proc[0].lv = 0;
+    a->proc[0].data = -1;
+    a->nproc = 1;
+    for (k = 0; ok && k < a->nproc; k++)
+        ok = analyse(a, &a->proc[k]) && calls(a, &a->proc[k]);
+
+    if (ok && (a->f = fopen(name, "w")) != NULL) {
+        runtime(a, name);
+        for (k = 0; ok && k < a->nproc; k++)
+            ok = procedure(a, &a->proc[k]);
+        driver(a);
+        fclose(a->f);
+    } else
+        ok = false;
+    release(a);
+
+    return ok;
+} // p4_aot
@@ -36,49 +36,240 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "p4_assembler.h"
 #include "p4_internal.h"
-#include "p4_functions.h"
 #include "p4_file.h"
 #include "p4_vm.h"
 
-static uint8_t op;
-static short q; // instruction register
-static short pc; // program address register
-static uint8_t p;
-static alfa_ instr[128]; // mnemonic instruction codes
-static long cop[128];
-static alfa_ sptable[21]; // standard functions and procedures
+static const alfa_ instr[DUMINST] = { // mnemonic instruction codes
+    "lod       ", "ldo       ", "str       ", "sro       ", "lda       ", "lao       ",
+    "sto       ", "ldc       ", "...       ", "ind       ", "inc       ", "mst       ",
+    "cup       ", "ent       ", "ret       ", "csp       ", "ixa       ", "equ       ",
+    "neq       ", "geq       ", "grt       ", "leq       ", "les       ", "ujp       ",
+    "fjp       ", "xjp       ", "chk       ", "eof       ", "adi       ", "adr       ",
+    "sbi       ", "sbr       ", "sgs       ", "flt       ", "flo       ", "trc       ",
+    "ngi       ", "ngr       ", "sqi       ", "sqr       ", "abi       ", "abr       ",
+    "not       ", "and       ", "ior       ", "dif       ", "int       ", "uni       ",
+    "inn       ", "mod       ", "odd       ", "mpi       ", "mpr       ", "dvi       ",
+    "dvr       ", "mov       ", "lca       ", "dec       ", "stp       ", "ord       ",
+    "chr       ", "ujc       ", "ixb       ", "ldb       ", "stb       "
+};
+
+static const alfa_ sptable[23] = { // standard functions and procedures
+    "get       ", "put       ", "rst       ", "rln       ", "new       ", "wln       ",
+    "wrs       ", "eln       ", "wri       ", "wrr       ", "wrc       ", "rdi       ",
+    "rdr       ", "rdc       ", "sin       ", "cos       ", "exp       ", "log       ",
+    "sqt       ", "atn       ", "sav       ", "rdb       ", "dsp       "
+};
+
+// perfect hash of the mnemonics of instr and sptable, each table has no two on the same entry
+#define HASH(a, b, c) (((uint8_t) (a) * 47 + (uint8_t) (b) * 36 + (uint8_t) (c)) & 255)
+
+static const uint8_t instrhash[256] = { // 1 + index in instr
+    [HASH('l', 'o', 'd')] = 1, [HASH('l', 'd', 'o')] = 2, [HASH('s', 't', 'r')] = 3, [HASH('s', 'r', 'o')] = 4,
+    [HASH('l', 'd', 'a')] = 5, [HASH('l', 'a', 'o')] = 6, [HASH('s', 't', 'o')] = 7, [HASH('l', 'd', 'c')] = 8,
+    [HASH('i', 'n', 'd')] = 10, [HASH('i', 'n', 'c')] = 11, [HASH('m', 's', 't')] = 12, [HASH('c', 'u', 'p')] = 13,
+    [HASH('e', 'n', 't')] = 14, [HASH('r', 'e', 't')] = 15, [HASH('c', 's', 'p')] = 16, [HASH('i', 'x', 'a')] = 17,
+    [HASH('e', 'q', 'u')] = 18, [HASH('n', 'e', 'q')] = 19, [HASH('g', 'e', 'q')] = 20, [HASH('g', 'r', 't')] = 21,
+    [HASH('l', 'e', 'q')] = 22, [HASH('l', 'e', 's')] = 23, [HASH('u', 'j', 'p')] = 24, [HASH('f', 'j', 'p')] = 25,
+    [HASH('x', 'j', 'p')] = 26, [HASH('c', 'h', 'k')] = 27, [HASH('e', 'o', 'f')] = 28, [HASH('a', 'd', 'i')] = 29,
+    [HASH('a', 'd', 'r')] = 30, [HASH('s', 'b', 'i')] = 31, [HASH('s', 'b', 'r')] = 32, [HASH('s', 'g', 's')] = 33,
+    [HASH('f', 'l', 't')] = 34, [HASH('f', 'l', 'o')] = 35, [HASH('t', 'r', 'c')] = 36, [HASH('n', 'g', 'i')] = 37,
+    [HASH('n', 'g', 'r')] = 38, [HASH('s', 'q', 'i')] = 39, [HASH('s', 'q', 'r')] = 40, [HASH('a', 'b', 'i')] = 41,
+    [HASH('a', 'b', 'r')] = 42, [HASH('n', 'o', 't')] = 43, [HASH('a', 'n', 'd')] = 44, [HASH('i', 'o', 'r')] = 45,
+    [HASH('d', 'i', 'f')] = 46, [HASH('i', 'n', 't')] = 47, [HASH('u', 'n', 'i')] = 48, [HASH('i', 'n', 'n')] = 49,
+    [HASH('m', 'o', 'd')] = 50, [HASH('o', 'd', 'd')] = 51, [HASH('m', 'p', 'i')] = 52, [HASH('m', 'p', 'r')] = 53,
+    [HASH('d', 'v', 'i')] = 54, [HASH('d', 'v', 'r')] = 55, [HASH('m', 'o', 'v')] = 56, [HASH('l', 'c', 'a')] = 57,
+    [HASH('d', 'e', 'c')] = 58, [HASH('s', 't', 'p')] = 59, [HASH('o', 'r', 'd')] = 60, [HASH('c', 'h', 'r')] = 61,
+    [HASH('u', 'j', 'c')] = 62, [HASH('i', 'x', 'b')] = 63, [HASH('l', 'd', 'b')] = 64, [HASH('s', 't', 'b')] = 65
+};
+
+static const uint8_t sphash[256] = { // 1 + index in sptable
+    [HASH('g', 'e', 't')] = 1, [HASH('p', 'u', 't')] = 2, [HASH('r', 's', 't')] = 3, [HASH('r', 'l', 'n')] = 4,
+    [HASH('n', 'e', 'w')] = 5, [HASH('w', 'l', 'n')] = 6, [HASH('w', 'r', 's')] = 7, [HASH('e', 'l', 'n')] = 8,
+    [HASH('w', 'r', 'i')] = 9, [HASH('w', 'r', 'r')] = 10, [HASH('w', 'r', 'c')] = 11, [HASH('r', 'd', 'i')] = 12,
+    [HASH('r', 'd', 'r')] = 13, [HASH('r', 'd', 'c')] = 14, [HASH('s', 'i', 'n')] = 15, [HASH('c', 'o', 's')] = 16,
+    [HASH('e', 'x', 'p')] = 17, [HASH('l', 'o', 'g')] = 18, [HASH('s', 'q', 't')] = 19, [HASH('a', 't', 'n')] = 20,
+    [HASH('s', 'a', 'v')] = 21, [HASH('r', 'd', 'b')] = 22, [HASH('d', 's', 'p')] = 23
+};
+
+static const uint8_t cop[128] = { // first typed variant of an operation (typesymbol)
+    [0] = 105, [1] = 65, [2] = 70, [3] = 75, [6] = 80, [9] = 85, [10] = 90, [26] = 95, [57] = 100
+};
 
 static void _errorl(char *string, loc_load_t *LINK) {
     // error in loading
     printf("\n%.25s", string);
-    _Escape(0);
+    longjmp(LINK->err, 1);
 } // errorl
 
+/* Constant pool.
+ ==============
+ Reals, sets, bounds and strings are placed in the constant pool of the vm,
+ after the variable store, in the order the code meets them; ldc, chk and lca
+ address their cells. Every constant is placed once: the cells already in the
+ pool are found by a hash of their contents in consttab, open addressing with
+ linear probing, doubled when half full. A string takes the cells of its chars
+ (CHARCELL to a cell, the rest of the last one 0), of any length. Constants
+ with the same bits share their cells, so the code never writes the pool. The
+ pool of the vm grows (p4_vm_grow, doubling) as it fills.
+ */
+
+// hash of the n cells of a constant
+static uint32_t hash(const rec_store_t *c, int32_t n) {
+    uint64_t h = n;
+    int32_t i;
+
+    for (i = 0; i < n; i++)
+        h = (h ^ c[i].vs) * 0x9e3779b97f4a7c15;
+    return h >> 32;
+} // hash
+
+// first of n free cells of the constant pool
+static int32_t pool(p4_vm_t p4vm, loc_load_t *LINK, int32_t n) {
+    int32_t ad = LINK->cp, need = LINK->cp + n - 1 - p4vm->maxstk, size;
+
+    if (need > p4vm->consts) {
+        size = (p4vm->consts > CONSTMAX / 2) ? CONSTMAX : 2 * p4vm->consts;
+        if (!p4_vm_grow(p4vm, (size > need) ? size : need))
+            _errorl(" constant pool overflow  ", LINK);
+    }
+    LINK->cp += n;
+
+    return ad;
+} // pool
+
+// consttab of twice the slots
+static void rehash(p4_vm_t p4vm, loc_load_t *LINK) {
+    constrec_t *tab;
+    uint32_t size = LINK->constsize ? 2 * LINK->constsize : 64, i, h;
+
+    if ((tab = calloc(size, sizeof(constrec_t))) == NULL)
+        _errorl(" not enough memory       ", LINK);
+    for (i = 0; i < LINK->constsize; i++) {
+        if (LINK->consttab[i].ad == 0)
+            continue;
+        for (h = hash(&(p4vm->store[LINK->consttab[i].ad]), LINK->consttab[i].n) & (size - 1); tab[h].ad != 0; h = (h + 1) & (size - 1))
+            ;
+        tab[h] = LINK->consttab[i];
+    }
+    free(LINK->consttab);
+    LINK->consttab = tab;
+    LINK->constsize = size;
+} // rehash
+
+// slot of consttab holding the n cells c, or the empty one where they go
+static constrec_t* slot(p4_vm_t p4vm, loc_load_t *LINK, const rec_store_t *c, int32_t n) {
+    constrec_t *WITH;
+    uint32_t h;
+
+    if (2 * (LINK->constn + 1) > LINK->constsize)
+        rehash(p4vm, LINK);
+    for (h = hash(c, n) & (LINK->constsize - 1); LINK->consttab[h].ad != 0; h = (h + 1) & (LINK->constsize - 1)) {
+        WITH = &LINK->consttab[h];
+        if (WITH->n == n && memcmp(&(p4vm->store[WITH->ad]), c, n * sizeof(rec_store_t)) == 0)
+            break;
+    }
+    return &LINK->consttab[h];
+} // slot
+
+// address of the first of the n cells c in the constant pool, placed the first time
+static int32_t constant(p4_vm_t p4vm, loc_load_t *LINK, const rec_store_t *c, int32_t n) {
+    constrec_t *WITH = slot(p4vm, LINK, c, n);
+
+    if (WITH->ad == 0) {
+        WITH->ad = pool(p4vm, LINK, n);
+        WITH->n = n;
+        LINK->constn++;
+        memcpy(&(p4vm->store[WITH->ad]), c, n * sizeof(rec_store_t));
+    }
+    return WITH->ad;
+} // constant
+
+// address of the len chars s in the constant pool, packed at the end of the pool to be looked up
+static int32_t literal(p4_vm_t p4vm, loc_load_t *LINK, const char *s, int32_t len) {
+    int32_t n = (len > 0) ? (len + CHARCELL - 1) / CHARCELL : 1, ad = pool(p4vm, LINK, n);
+    constrec_t *WITH;
+
+    memcpy(&(CHARS(p4vm)[CHARADR(ad, 0)]), s, len);
+    WITH = slot(p4vm, LINK, &(p4vm->store[ad]), n);
+    if (WITH->ad != 0) { // placed before, the cells go back to the pool
+        memset(&(p4vm->store[ad]), 0, n * sizeof(rec_store_t));
+        LINK->cp = ad;
+        return WITH->ad;
+    }
+    WITH->ad = ad;
+    WITH->n = n;
+    LINK->constn++;
+
+    return ad;
+} // literal
+
+// next character of the code, end of line read as a blank
+static void getch(loc_load_t *LINK) {
+    LINK->ch = (LINK->at < LINK->len) ? LINK->buf[LINK->at++] : EOF;
+    if (LINK->ch == '\n')
+        LINK->ch = ' ';
+} // getch
+
+static bool eoln(loc_load_t *LINK) {
+    return LINK->at >= LINK->len || LINK->buf[LINK->at] == '\n';
+} // eoln
+
+// integer after blanks (and ends of line), 0 if there is none
+static long number(loc_load_t *LINK) {
+    char *end;
+    long n = strtol(LINK->buf + LINK->at, &end, 10);
+
+    LINK->at = end - LINK->buf;
+    return n;
+} // number
+
+static double real(loc_load_t *LINK) {
+    char *end;
+    double r = strtod(LINK->buf + LINK->at, &end);
+
+    LINK->at = end - LINK->buf;
+    return r;
+} // real
+
+// rest of the line, and the end of line
+static void skipline(loc_load_t *LINK) {
+    char *nl = memchr(LINK->buf + LINK->at, '\n', LINK->len - LINK->at);
+
+    LINK->at = (nl != NULL) ? (size_t) (nl - LINK->buf) + 1 : LINK->len;
+} // skipline
+
+// index of name in table through its hash, -1 if it is not there
+static int32_t search(const alfa_ *table, const uint8_t *hash, const char *name) {
+    int32_t i = hash[HASH(name[0], name[1], name[2])] - 1;
+
+    return (i >= 0 && memcmp(table[i], name, sizeof(alfa_)) == 0) ? i : -1;
+} // search
+
 static void getname(loc_assemble_t *LINK) {
-    LINK->LINK->word[0] = LINK->LINK->ch;
-    LINK->LINK->word[1] = getc(prd.f);
-    LINK->LINK->word[2] = getc(prd.f);
-    if (LINK->LINK->word[1] == '\n')
-        LINK->LINK->word[1] = ' ';
-    if (LINK->LINK->word[2] == '\n')
-        LINK->LINK->word[2] = ' ';
-    if (!p4_file_eoln(prd.f)) {
-        LINK->LINK->ch = getc(prd.f); // next character
-        if (LINK->LINK->ch == '\n')
-            LINK->LINK->ch = ' ';
+    char ch = LINK->LINK->ch;
+
+    LINK->LINK->word[0] = ch;
+    getch(LINK->LINK);
+    LINK->LINK->word[1] = LINK->LINK->ch;
+    getch(LINK->LINK);
+    LINK->LINK->word[2] = LINK->LINK->ch;
+    LINK->LINK->ch = ch;
+    if (!eoln(LINK->LINK)) {
+        getch(LINK->LINK); // next character
     }
     memcpy(LINK->name, LINK->LINK->word, sizeof(alfa_));
 } // getname
 
-static void typesymbol(loc_assemble_t *LINK) {
+static uint8_t typesymbol(loc_assemble_t *LINK, uint8_t op) {
     long i = 0;
 
     // typesymbol
     if (LINK->LINK->ch == 'i')
-        return;
+        return op;
     switch (LINK->LINK->ch) {
 
         case 'a':
@@ -101,55 +292,79 @@ static void typesymbol(loc_assemble_t *LINK) {
             i = 4;
             break;
     }
-    op = cop[op] + i;
-}
+    return cop[op] + i;
+} // typesymbol
+
+// entry of label x, labeltab grows (doubling) to hold it
+// the compiler numbers its labels in order and writes each one, so a label is below the length of the text
+static labelrec_t* label(long x, loc_load_t *LINK) {
+    labelrec_t *tab;
+    int32_t size, i;
+
+    if (x < 0 || x >= PCMAX || (size_t) x > LINK->len)
+        _errorl(" illegal label           ", LINK);
+    if (x >= LINK->maxlabel) {
+        size = (x < LINK->maxlabel * 2) ? LINK->maxlabel * 2 : x + 1;
+        if ((tab = realloc(LINK->labeltab, size * sizeof(labelrec_t))) == NULL)
+            _errorl(" not enough memory       ", LINK);
+        for (i = LINK->maxlabel; i < size; i++) {
+            tab[i].val = -1;
+            tab[i].st = ENTERED;
+        }
+        LINK->labeltab = tab;
+        LINK->maxlabel = size;
+    }
+    return &LINK->labeltab[x];
+} // label
+
+static int32_t lookup(long x, loc_assemble_t *LINK) {
+    labelrec_t *WITH = label(x, LINK->LINK);
+    int32_t q = 0;
 
-static void lookup(p4_vm_t p4vm, short x, loc_assemble_t *LINK) {
     // search in label table
-    switch (LINK->LINK->labeltab[x].st) {
+    switch (WITH->st) {
 
         case ENTERED:
-            q = LINK->LINK->labeltab[x].val;
-            LINK->LINK->labeltab[x].val = pc;
+            q = WITH->val;
+            WITH->val = LINK->LINK->pc;
             break;
 
         case DEFINED:
-            q = LINK->LINK->labeltab[x].val;
+            q = WITH->val;
             break;
     } // case label..
+    return q;
 } // lookup
 
-static void labelsearch(p4_vm_t p4vm, loc_assemble_t *LINK) {
-    short x;
+static int32_t labelsearch(loc_assemble_t *LINK) {
+    long x;
 
-    while ((LINK->LINK->ch != 'l') & (!p4_file_eoln(prd.f))) {
-        LINK->LINK->ch = getc(prd.f);
-        if (LINK->LINK->ch == '\n')
-            LINK->LINK->ch = ' ';
+    while ((LINK->LINK->ch != 'l') & (!eoln(LINK->LINK))) {
+        getch(LINK->LINK);
     }
-    fscanf(prd.f, "%hd", &x);
-    lookup(p4vm, x, LINK);
+    x = number(LINK->LINK);
+    return lookup(x, LINK);
 } // labelsearch
 
 static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
     // translate symbolic code into machine code and store
     loc_assemble_t V;
-    double r;
-    settype s;
-    long i, s1, lb, ub;
-    int TEMP;
+    rec_store_t c[2];
+    long i, s1;
+    char *from, *end;
     rec_code_t *WITH;
+    uint8_t op, p;
+    int32_t q; // instruction register
 
     V.LINK = LINK;
     p = 0;
     q = 0;
     op = 0;
     getname(&V);
-    memcpy(instr[DUMINST], V.name, sizeof(alfa_));
-    while (strncmp(instr[op], V.name, sizeof(alfa_)))
-        op++;
-    if (op == DUMINST)
+    if ((q = search(instr, instrhash, V.name)) < 0)
         _errorl(" illegal instruction     ", LINK);
+    op = q;
+    q = 0;
 
     switch (op) { // get parameters p,q
 
@@ -187,7 +402,7 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
 
                 case 'm':
                     p = 5;
-                    fscanf(prd.f, "%hd", &q);
+                    q = number(LINK);
                     break;
             }
             break;
@@ -195,25 +410,23 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
             // lod,str
         case 0:
         case 2:
-            typesymbol(&V);
-            fscanf(prd.f, "%d%hd", &TEMP, &q);
-            p = TEMP;
+            op = typesymbol(&V, op);
+            p = number(LINK);
+            q = number(LINK);
             break;
 
         case 4: // lda
-            fscanf(prd.f, "%d%hd", &TEMP, &q);
-            p = TEMP;
+            p = number(LINK);
+            q = number(LINK);
             break;
 
         case 12: // cup
-            fscanf(prd.f, "%d", &TEMP);
-            p = TEMP;
-            labelsearch(p4vm, &V);
+            p = number(LINK);
+            q = labelsearch(&V);
             break;
 
         case 11: // mst
-            fscanf(prd.f, "%d", &TEMP);
-            p = TEMP;
+            p = number(LINK);
             break;
 
         case 14: // ret
@@ -249,7 +462,7 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
         case 5:
         case 16:
         case 55:
-            fscanf(prd.f, "%hd", &q);
+            q = number(LINK);
             break;
 
             // ldo,sro,ind,inc,dec
@@ -258,32 +471,29 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
         case 9:
         case 10:
         case 57:
-            typesymbol(&V);
-            fscanf(prd.f, "%hd", &q);
+            op = typesymbol(&V, op);
+            q = number(LINK);
             break;
 
             // ujp,fjp,xjp
         case 23:
         case 24:
         case 25:
-            labelsearch(p4vm, &V);
+            q = labelsearch(&V);
             break;
 
         case 13: // ent
-            fscanf(prd.f, "%d", &TEMP);
-            p = TEMP;
-            labelsearch(p4vm, &V);
+            p = number(LINK);
+            q = labelsearch(&V);
             break;
 
         case 15: // csp
             for (i = 1; i <= 9; i++) {
-                LINK->ch = getc(prd.f);
-                if (LINK->ch == '\n')
-                    LINK->ch = ' ';
+                getch(LINK);
             }
             getname(&V);
-            while (strncmp(V.name, sptable[q], sizeof(alfa_)))
-                q++;
+            if ((q = search(sptable, sphash, V.name)) < 0)
+                _errorl(" illegal procedure       ", LINK);
             break;
 
         case 7: // ldc
@@ -291,37 +501,14 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
 
                 case 'i':
                     p = 1;
-                    fscanf(prd.f, "%ld", &i);
-                    if (labs(i) >= LARGEINT) {
-                        op = 8;
-                        p4vm->store[LINK->icp].vi = i;
-                        q = MAXSTK;
-                        do {
-                            q++;
-                        } while (p4vm->store[q].vi != i);
-                        if (q == LINK->icp) {
-                            LINK->icp++;
-                            if (LINK->icp == OVERI)
-                                _errorl(" integer table overflow  ", LINK);
-                        }
-                    } else
-                        q = i;
+                    q = number(LINK);
                     break;
 
                 case 'r':
                     op = 8;
                     p = 2;
-                    fscanf(prd.f, "%lg", &r);
-                    p4vm->store[LINK->rcp].vr = r;
-                    q = OVERI;
-                    do {
-                        q++;
-                    } while (p4vm->store[q].vr != r);
-                    if (q == LINK->rcp) {
-                        LINK->rcp++;
-                        if (LINK->rcp == OVERR)
-                            _errorl(" real table overflow     ", LINK);
-                    }
+                    c[0].vr = real(LINK);
+                    q = constant(p4vm, LINK, c, 1);
                     break;
 
                 case 'n': // p,q = 0
@@ -329,25 +516,19 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
 
                 case 'b':
                     p = 3;
-                    fscanf(prd.f, "%hd", &q);
+                    q = number(LINK);
                     break;
 
                 case 'c':
                     p = 6;
                     do {
-                        LINK->ch = getc(prd.f);
-                        if (LINK->ch == '\n')
-                            LINK->ch = ' ';
+                        getch(LINK);
                     } while (LINK->ch == ' ');
                     if (LINK->ch != '\'')
                         _errorl(" illegal character       ", LINK);
-                    LINK->ch = getc(prd.f);
-                    if (LINK->ch == '\n')
-                        LINK->ch = ' ';
+                    getch(LINK);
                     q = LINK->ch;
-                    LINK->ch = getc(prd.f);
-                    if (LINK->ch == '\n')
-                        LINK->ch = ' ';
+                    getch(LINK);
                     if (LINK->ch != '\'')
                         _errorl(" illegal character       ", LINK);
                     break;
@@ -355,65 +536,47 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
                 case '(':
                     op = 8;
                     p = 4;
-                    p4_fn_expset(s, 0);
-                    LINK->ch = getc(prd.f);
-                    if (LINK->ch == '\n')
-                        LINK->ch = ' ';
+                    c[0].vs = 0;
+                    getch(LINK);
                     while (LINK->ch != ')') {
-                        fscanf(prd.f, "%ld%c", &s1, &LINK->ch);
-                        if (LINK->ch == '\n')
-                            LINK->ch = ' ';
-                        p4_fn_addset(s, s1);
-                    }
-                    p4_fn_setcpy(p4vm->store[LINK->scp].vs, s);
-                    q = OVERR;
-                    do {
-                        q++;
-                    } while (!p4_fn_setequal(p4vm->store[q].vs, s));
-                    if (q == LINK->scp) {
-                        LINK->scp++;
-                        if (LINK->scp == OVERS)
-                            _errorl(" set table overflow      ", LINK);
+                        if (LINK->at >= LINK->len)
+                            _errorl(" unexpected end of file  ", LINK);
+                        s1 = number(LINK);
+                        getch(LINK);
+                        if ((unsigned long) s1 >= SETMAX)
+                            _errorl(" set element out of range", LINK);
+                        c[0].vs |= (setbits_t) 1 << s1;
                     }
+                    q = constant(p4vm, LINK, c, 1);
                     break;
             } // case
             break;
 
         case 26: // chk
-            typesymbol(&V);
-            fscanf(prd.f, "%ld%ld", &lb, &ub);
+            op = typesymbol(&V, op);
+            memset(c, 0, sizeof(c));
+            c[0].vi = number(LINK);
+            c[1].vi = number(LINK);
             if (op == 95)
-                q = lb;
-            else {
-                p4vm->store[LINK->bcp - 1].vi = lb;
-                p4vm->store[LINK->bcp].vi = ub;
-                q = OVERS;
-                do {
-                    q += 2;
-                } while (p4vm->store[q - 1].vi != lb || p4vm->store[q].vi != ub);
-                if (q == LINK->bcp) {
-                    LINK->bcp += 2;
-                    if (LINK->bcp == OVERB)
-                        _errorl(" boundary table overflow ", LINK);
-                }
-            }
+                q = c[0].vi;
+            else
+                q = constant(p4vm, LINK, c, 2) + 1; // lower bound at q - 1
             break;
 
         case 56: // lca
-            if (LINK->mcp + 16 >= OVERM)
-                _errorl(" multiple table overflow ", LINK);
-            LINK->mcp += 16;
-            q = LINK->mcp;
-            for (i = 0; i <= 15; i++) { // stringlgth
-                LINK->ch = getc(prd.f);
-                if (LINK->ch == '\n')
-                    LINK->ch = ' ';
-                p4vm->store[q + i].vc = LINK->ch;
-            }
+            // the string follows the quote in ch up to the last quote of the line, so it may hold quotes
+            from = LINK->buf + LINK->at;
+            if ((end = memchr(from, '\n', LINK->len - LINK->at)) == NULL)
+                end = LINK->buf + LINK->len;
+            while (end > from && end[-1] != '\'')
+                end--;
+            if (LINK->ch != '\'' || end == from)
+                _errorl(" illegal character       ", LINK);
+            q = literal(p4vm, LINK, from, end - 1 - from);
             break;
 
         case 6: // sto
-            typesymbol(&V);
+            op = typesymbol(&V, op);
             break;
 
         case 27:
@@ -445,6 +608,9 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
         case 53:
         case 54:
         case 58:
+        case 62:
+        case 63:
+        case 64:
             break;
 
             // ord,chr
@@ -459,9 +625,15 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
 
     } // case
 
-    WITH = &(p4vm->code[pc / 2]);
+    // lod, ldo, str, sro, lda and lao address the store at a fixed offset, the reservation of the vm reaches a store further
+    if ((op <= 5 || (op >= 65 && op <= 79) || op >= 105) && (q < 0 || q > p4vm->maxstk))
+        _errorl(" address out of range    ", LINK);
+
+    if ((uint32_t) LINK->pc >= p4vm->image->size && !p4_vm_reserve(p4vm, LINK->pc + 1))
+        _errorl(" program too long        ", LINK);
+    WITH = &(p4vm->code[LINK->pc / 2]);
     // store instruction
-    if (pc & 1) {
+    if (LINK->pc & 1) {
         WITH->op2 = op;
         WITH->p2 = p;
         WITH->q2 = q;
@@ -470,25 +642,25 @@ static void assemble(p4_vm_t p4vm, loc_load_t *LINK) {
         WITH->p1 = p;
         WITH->q1 = q;
     }
-    pc++;
+    LINK->pc++;
     _L1:
-    fscanf(prd.f, "%*[^\n]");
-    getc(prd.f);
+    skipline(LINK);
 } // assemble
 
-static void update(p4_vm_t p4vm, short x, loc_load_t *LINK) {
+static void update(p4_vm_t p4vm, long x, loc_load_t *LINK) {
     // when a label definition lx is found
-    short curr, succ;
+    int32_t curr, succ;
     // resp. current element and successor element of a list of future references
     bool endlist;
     rec_code_t *WITH;
+    labelrec_t *lab = label(x, LINK);
 
-    if (LINK->labeltab[x].st == DEFINED) {
+    if (lab->st == DEFINED) {
         _errorl(" duplicated label\t       ", LINK);
         return;
     }
-    if (LINK->labeltab[x].val != -1) { // forward reference(s)
-        curr = LINK->labeltab[x].val;
+    if (lab->val != -1) { // forward reference(s)
+        curr = lab->val;
         endlist = false;
         while (!endlist) {
             WITH = &(p4vm->code[curr / 2]);
@@ -505,8 +677,8 @@ static void update(p4_vm_t p4vm, short x, loc_load_t *LINK) {
                 curr = succ;
         }
     }
-    LINK->labeltab[x].st = DEFINED;
-    LINK->labeltab[x].val = LINK->labelvalue;
+    lab->st = DEFINED;
+    lab->val = LINK->labelvalue;
 } // update
 
 static void generate(p4_vm_t p4vm, loc_load_t *LINK) {
@@ -516,177 +688,241 @@ static void generate(p4_vm_t p4vm, loc_load_t *LINK) {
 
     again = true;
     while (again) {
-        LINK->ch = getc(prd.f); // first character of line
-        if (LINK->ch == '\n')
-            LINK->ch = ' ';
+        if (LINK->at >= LINK->len)
+            _errorl(" unexpected end of file  ", LINK);
+        getch(LINK); // first character of line
         switch (LINK->ch) {
 
             case 'i':
-                fscanf(prd.f, "%*[^\n]");
-                getc(prd.f);
+                skipline(LINK);
                 break;
 
             case 'l':
-                fscanf(prd.f, "%ld", &x);
-                if (!p4_file_eoln(prd.f)) {
-                    LINK->ch = getc(prd.f);
-                    if (LINK->ch == '\n')
-                        LINK->ch = ' ';
+                x = number(LINK);
+                if (!eoln(LINK)) {
+                    getch(LINK);
                 }
                 if (LINK->ch == '=')
-                    fscanf(prd.f, "%hd", &LINK->labelvalue);
+                    LINK->labelvalue = number(LINK);
                 else
-                    LINK->labelvalue = pc;
+                    LINK->labelvalue = LINK->pc;
                 update(p4vm, x, LINK);
-                fscanf(prd.f, "%*[^\n]");
-                getc(prd.f);
+                skipline(LINK);
                 break;
 
             case 'q':
                 again = false;
-                fscanf(prd.f, "%*[^\n]");
-                getc(prd.f);
+                skipline(LINK);
                 break;
 
             case ' ':
-                LINK->ch = getc(prd.f);
-                if (LINK->ch == '\n')
-                    LINK->ch = ' ';
+                getch(LINK);
                 assemble(p4vm, LINK);
                 break;
         }
     }
 } // generate
 
+static bool fusible(bool *target, uint32_t at, uint32_t w, uint32_t n) {
+    // the covered addresses must not be reached by any jump or call
+    uint32_t i;
+
+    if (at + w > n)
+        return false;
+    for (i = at + 1; i < at + w; i++)
+        if (target[i])
+            return false;
+    return true;
+} // fusible
+
+static bool fuseword(rec_insn_t *c, int32_t bit, int32_t *mask) {
+    // lodi 0 x (local, sets bit in mask) or ldoi x
+    if (c->op == 0 && c->p == 0) {
+        *mask |= bit;
+        return true;
+    }
+    return c->op == 1;
+} // fuseword
+
+static bool fusecmp(rec_insn_t *c) {
+    // equi..lesi
+    return c->op >= OP_RELOP && c->op < OP_RELOP + 42 && (c->op - OP_RELOP) % 7 == 1;
+} // fusecmp
+
+static void fuse(p4_vm_t p4vm) {
+    // rewrite the selected sequences of insn[] into fused instructions
+    rec_insn_t *c = p4vm->insn;
+    uint32_t at, n = p4vm->codelen, w;
+    uint16_t fop;
+    int32_t mask, k, lb, s1, ind;
+    bool *target;
+
+    target = calloc(n + 1, sizeof(bool));
+    if (target == NULL)
+        return;
+    for (at = 0; at < n; at++)
+        switch (c[at].op) {
+            case 12: // cup
+            case 23: // ujp
+            case 24: // fjp
+            case 25: // xjp
+                if (c[at].q >= 0 && (uint32_t) c[at].q <= n)
+                    target[c[at].q] = true;
+                break;
+        }
+
+    for (at = 0; at < n; at += c[at].w) {
+        mask = 0;
+
+        // lda 0 a | lao a; lodi 0 x | ldoi x; [chki]; [deci/inci lb]; ixa s; [ind k]
+        if ((p4vm->fuse & FUSE_IXA) && ((c[at].op == 4 && c[at].p == 0) || c[at].op == 5) && at + 2 < n
+                && fuseword(&c[at + 1], 2, &mask)) {
+            w = 2;
+            k = 0;
+            lb = 0;
+            ind = 0;
+            if (c[at + w].op == 26)
+                k = c[at + w++].q;
+            if (at + w < n && (c[at + w].op == 57 || c[at + w].op == 10)) {
+                lb = (c[at + w].op == 57) ? c[at + w].q : -c[at + w].q;
+                w++;
+            }
+            if (at + w < n && c[at + w].op == 16) {
+                s1 = c[at + w++].q;
+                fop = OP_IXAD;
+                if (at + w < n && (c[at + w].op == 9 || (c[at + w].op >= 85 && c[at + w].op <= 89 && c[at + w].op != 87))) {
+                    ind = c[at + w++].q;
+                    fop = OP_IXLD;
+                }
+                if (fusible(target, at, w, n)) {
+                    // the lower bound is folded into the base address
+                    if (c[at].op == 4)
+                        mask |= 1;
+                    c[at + 1].p = k;
+                    c[at].r = c[at + 1].q;
+                    c[at + 1].r = ind;
+                    c[at + 1].q = s1;
+                    c[at].q -= s1 * lb;
+                    c[at].op = fop;
+                    c[at].p = mask;
+                    c[at].w = w;
+                    continue;
+                }
+            }
+            mask = 0;
+        }
+
+        // lodi p q | ldoi q; inci k | deci k | ldci k, adi | ldci k, sbi; stri p q | sroi q
+        if ((p4vm->fuse & FUSE_INC) && (c[at].op == 0 || c[at].op == 1) && at + 2 < n) {
+            w = 0;
+            k = 0;
+            if (c[at + 1].op == 10 || c[at + 1].op == 57) {
+                k = (c[at + 1].op == 10) ? c[at + 1].q : -c[at + 1].q;
+                w = 3;
+            } else if (c[at + 1].op == 7 && c[at + 1].p == 1 && at + 3 < n && (c[at + 2].op == 28 || c[at + 2].op == 30)) {
+                k = (c[at + 2].op == 28) ? c[at + 1].q : -c[at + 1].q;
+                w = 4;
+            }
+            if (w != 0 && c[at + w - 1].op == c[at].op + 2 && c[at + w - 1].p == c[at].p && c[at + w - 1].q == c[at].q
+                    && fusible(target, at, w, n)) {
+                c[at].op = (c[at].op == 0) ? OP_INCL : OP_INCO;
+                c[at].r = k;
+                c[at].w = w;
+                continue;
+            }
+        }
+
+        if (p4vm->fuse & FUSE_CMPJ) {
+            // lodi 0 a | ldoi a; lodi 0 b | ldoi b | ldci k; equi..lesi; fjp
+            if (at + 3 < n && fuseword(&c[at], 1, &mask) && fusecmp(&c[at + 2]) && c[at + 3].op == 24
+                    && (fuseword(&c[at + 1], 2, &mask) || (c[at + 1].op == 7 && c[at + 1].p == 1)) && fusible(target, at, 4, n)) {
+                fop = ((c[at + 1].op == 7) ? OP_CONJ : OP_VARJ) + (c[at + 2].op - OP_RELOP) / 7;
+                c[at].op = fop;
+                c[at].p = mask;
+                c[at].r = c[at + 1].q;
+                c[at].w = 4;
+                c[at + 1].q = c[at + 3].q;
+                continue;
+            }
+
+            // equi..lesi; fjp
+            if (at + 1 < n && fusecmp(&c[at]) && c[at + 1].op == 24 && fusible(target, at, 2, n)) {
+                c[at].op = OP_CMPJ + (c[at].op - OP_RELOP) / 7;
+                c[at].q = c[at + 1].q;
+                c[at].w = 2;
+            }
+        }
+    }
+
+    free(target);
+} // fuse
+
 static void init(p4_vm_t p4vm, loc_load_t *LINK) {
     long i;
-    labelrec_t *WITH;
-
-    memcpy(instr[0], "lod       ", sizeof(alfa_));
-    memcpy(instr[1], "ldo       ", sizeof(alfa_));
-    memcpy(instr[2], "str       ", sizeof(alfa_));
-    memcpy(instr[3], "sro       ", sizeof(alfa_));
-    memcpy(instr[4], "lda       ", sizeof(alfa_));
-    memcpy(instr[5], "lao       ", sizeof(alfa_));
-    memcpy(instr[6], "sto       ", sizeof(alfa_));
-    memcpy(instr[7], "ldc       ", sizeof(alfa_));
-    memcpy(instr[8], "...       ", sizeof(alfa_));
-    memcpy(instr[9], "ind       ", sizeof(alfa_));
-    memcpy(instr[10], "inc       ", sizeof(alfa_));
-    memcpy(instr[11], "mst       ", sizeof(alfa_));
-    memcpy(instr[12], "cup       ", sizeof(alfa_));
-    memcpy(instr[13], "ent       ", sizeof(alfa_));
-    memcpy(instr[14], "ret       ", sizeof(alfa_));
-    memcpy(instr[15], "csp       ", sizeof(alfa_));
-    memcpy(instr[16], "ixa       ", sizeof(alfa_));
-    memcpy(instr[17], "equ       ", sizeof(alfa_));
-    memcpy(instr[18], "neq       ", sizeof(alfa_));
-    memcpy(instr[19], "geq       ", sizeof(alfa_));
-    memcpy(instr[20], "grt       ", sizeof(alfa_));
-    memcpy(instr[21], "leq       ", sizeof(alfa_));
-    memcpy(instr[22], "les       ", sizeof(alfa_));
-    memcpy(instr[23], "ujp       ", sizeof(alfa_));
-    memcpy(instr[24], "fjp       ", sizeof(alfa_));
-    memcpy(instr[25], "xjp       ", sizeof(alfa_));
-    memcpy(instr[26], "chk       ", sizeof(alfa_));
-    memcpy(instr[27], "eof       ", sizeof(alfa_));
-    memcpy(instr[28], "adi       ", sizeof(alfa_));
-    memcpy(instr[29], "adr       ", sizeof(alfa_));
-    memcpy(instr[30], "sbi       ", sizeof(alfa_));
-    memcpy(instr[31], "sbr       ", sizeof(alfa_));
-    memcpy(instr[32], "sgs       ", sizeof(alfa_));
-    memcpy(instr[33], "flt       ", sizeof(alfa_));
-    memcpy(instr[34], "flo       ", sizeof(alfa_));
-    memcpy(instr[35], "trc       ", sizeof(alfa_));
-    memcpy(instr[36], "ngi       ", sizeof(alfa_));
-    memcpy(instr[37], "ngr       ", sizeof(alfa_));
-    memcpy(instr[38], "sqi       ", sizeof(alfa_));
-    memcpy(instr[39], "sqr       ", sizeof(alfa_));
-    memcpy(instr[40], "abi       ", sizeof(alfa_));
-    memcpy(instr[41], "abr       ", sizeof(alfa_));
-    memcpy(instr[42], "not       ", sizeof(alfa_));
-    memcpy(instr[43], "and       ", sizeof(alfa_));
-    memcpy(instr[44], "ior       ", sizeof(alfa_));
-    memcpy(instr[45], "dif       ", sizeof(alfa_));
-    memcpy(instr[46], "int       ", sizeof(alfa_));
-    memcpy(instr[47], "uni       ", sizeof(alfa_));
-    memcpy(instr[48], "inn       ", sizeof(alfa_));
-    memcpy(instr[49], "mod       ", sizeof(alfa_));
-    memcpy(instr[50], "odd       ", sizeof(alfa_));
-    memcpy(instr[51], "mpi       ", sizeof(alfa_));
-    memcpy(instr[52], "mpr       ", sizeof(alfa_));
-    memcpy(instr[53], "dvi       ", sizeof(alfa_));
-    memcpy(instr[54], "dvr       ", sizeof(alfa_));
-    memcpy(instr[55], "mov       ", sizeof(alfa_));
-    memcpy(instr[56], "lca       ", sizeof(alfa_));
-    memcpy(instr[57], "dec       ", sizeof(alfa_));
-    memcpy(instr[58], "stp       ", sizeof(alfa_));
-    memcpy(instr[59], "ord       ", sizeof(alfa_));
-    memcpy(instr[60], "chr       ", sizeof(alfa_));
-    memcpy(instr[61], "ujc       ", sizeof(alfa_));
-
-    memcpy(sptable[0], "get       ", sizeof(alfa_));
-    memcpy(sptable[1], "put       ", sizeof(alfa_));
-    memcpy(sptable[2], "rst       ", sizeof(alfa_));
-    memcpy(sptable[3], "rln       ", sizeof(alfa_));
-    memcpy(sptable[4], "new       ", sizeof(alfa_));
-    memcpy(sptable[5], "wln       ", sizeof(alfa_));
-    memcpy(sptable[6], "wrs       ", sizeof(alfa_));
-    memcpy(sptable[7], "eln       ", sizeof(alfa_));
-    memcpy(sptable[8], "wri       ", sizeof(alfa_));
-    memcpy(sptable[9], "wrr       ", sizeof(alfa_));
-    memcpy(sptable[10], "wrc       ", sizeof(alfa_));
-    memcpy(sptable[11], "rdi       ", sizeof(alfa_));
-    memcpy(sptable[12], "rdr       ", sizeof(alfa_));
-    memcpy(sptable[13], "rdc       ", sizeof(alfa_));
-    memcpy(sptable[14], "sin       ", sizeof(alfa_));
-    memcpy(sptable[15], "cos       ", sizeof(alfa_));
-    memcpy(sptable[16], "exp       ", sizeof(alfa_));
-    memcpy(sptable[17], "log       ", sizeof(alfa_));
-    memcpy(sptable[18], "sqt       ", sizeof(alfa_));
-    memcpy(sptable[19], "atn       ", sizeof(alfa_));
-    memcpy(sptable[20], "sav       ", sizeof(alfa_));
-
-    cop[0] = 105;
-    cop[1] = 65;
-    cop[2] = 70;
-    cop[3] = 75;
-    cop[6] = 80;
-    cop[9] = 85;
-    cop[10] = 90;
-    cop[26] = 95;
-    cop[57] = 100;
-
-    pc = BEGINCODE;
-    LINK->icp = MAXSTK + 1;
-    LINK->rcp = OVERI + 1;
-    LINK->scp = OVERR + 1;
-    LINK->bcp = OVERS + 2;
-    LINK->mcp = OVERB + 1;
+    struct stat st;
+    size_t size;
+    char *buf;
+
+    LINK->pc = BEGINCODE;
+    LINK->cp = p4vm->maxstk + 1;
     for (i = 0; i <= 9; i++)
         LINK->word[i] = ' ';
-    for (i = 0; i <= MAXLABEL; i++) {
-        WITH = &LINK->labeltab[i];
-        WITH->val = -1;
-        WITH->st = ENTERED;
-    }
-    if (*prd.name != '\0') {
-        if (prd.f != NULL)
-            prd.f = freopen(prd.name, "r", prd.f);
+    if (*LINK->prd->name != '\0') {
+        if (LINK->prd->f != NULL)
+            LINK->prd->f = freopen(LINK->prd->name, "r", LINK->prd->f);
         else
-            prd.f = fopen(prd.name, "r");
+            LINK->prd->f = fopen(LINK->prd->name, "r");
     } else
-        rewind(prd.f);
-    if (prd.f == NULL)
-        _EscIO(FileNotFound);
-    prd.f_BFLAGS = 1;
+        rewind(LINK->prd->f);
+    if (LINK->prd->f == NULL)
+        _errorl(" file not found          ", LINK);
+    LINK->prd->f_BFLAGS = 1;
+
+    // the text is read in blocks of size, doubled as it grows, and scanned from memory
+    size = (fstat(fileno(LINK->prd->f), &st) == 0 && st.st_size > 0) ? st.st_size + 1 : 65536;
+    for (;;) {
+        if ((buf = realloc(LINK->buf, size + 1)) == NULL)
+            _errorl(" not enough memory       ", LINK);
+        LINK->buf = buf;
+        LINK->len += fread(LINK->buf + LINK->len, 1, size - LINK->len, LINK->prd->f);
+        if (LINK->len < size)
+            break;
+        size *= 2;
+    }
+    LINK->buf[LINK->len] = '\0';
 } // init
 
-void p4_assembler(p4_vm_t p4vm) {
+bool p4_assembler(p4_vm_t p4vm) {
     loc_load_t V;
 
+    V.prd = &p4vm->prd;
+    V.buf = NULL;
+    V.at = 0;
+    V.len = 0;
+    V.consttab = NULL;
+    V.constsize = 0;
+    V.constn = 0;
+    V.labeltab = NULL;
+    V.maxlabel = 0;
+    if (setjmp(V.err)) {
+        free(V.buf);
+        free(V.consttab);
+        free(V.labeltab);
+        return false;
+    }
     init(p4vm, &V);
     generate(p4vm, &V);
-    pc = 0;
+    p4vm->codelen = V.pc;
+    V.pc = 0;
     generate(p4vm, &V);
+    p4_vm_decode(p4vm);
+    fuse(p4vm);
+
+    // the program reads prd from the end of its code
+    fseek(p4vm->prd.f, V.at, SEEK_SET);
+    free(V.buf);
+    free(V.consttab);
+    free(V.labeltab);
+
+    return true;
 } // load
@@ -34,9 +34,10 @@
 #ifndef P4_ASSEMBLER_H_
 #define P4_ASSEMBLER_H_
 
-#include "p4_vm.h"
+#include <setjmp.h>
+#include <stdbool.h>
 
-#define MAXLABEL 1850
+#include "p4_vm.h"
 
 typedef char alfa_[10];
 
@@ -47,17 +48,31 @@ typedef enum LABELST {
 
 // label range
 typedef struct labelrec {
-    short val;
+    int32_t val;
     labelst_t st;
 } labelrec_t;
 
+// constant placed in the pool of the vm
+typedef struct constrec {
+    int32_t ad; // first cell, 0 for an empty slot of consttab
+    int32_t n;  // cells
+} constrec_t;
+
 // static variables for load:
 typedef struct loc_load_s {
-    short icp, rcp, scp, bcp, mcp; // pointers to next free position
+    int32_t cp; // next free cell of the constant pool
+    constrec_t *consttab; // constants of the pool by hash of their cells
+    uint32_t constsize, constn; // slots of consttab (a power of 2), constants in it
     char word[10];
     char ch;
-    labelrec_t labeltab[MAXLABEL + 1];
-    short labelvalue;
+    labelrec_t *labeltab; // entries 0 .. maxlabel - 1, grown by label
+    int32_t maxlabel;
+    int32_t labelvalue;
+    int32_t pc; // program address register
+    file_t *prd; // code being loaded
+    char *buf;   // text of prd read whole by init, 0 terminated
+    size_t at, len; // next character of buf, length of the text
+    jmp_buf err; // way out on a loading error
 } loc_load_t;
 
 // static variables for pmd:
@@ -72,6 +87,6 @@ typedef struct loc_assemble_s {
     alfa_ name;
 } loc_assemble_t;
 
-void p4_assembler(p4_vm_t p4vm);
+bool p4_assembler(p4_vm_t p4vm);
 
 #endif /* P4_ASSEMBLER_H_ */
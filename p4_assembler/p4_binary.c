@@ -0,0 +1,345 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "p4_vm.h"
+#include "p4_binary.h"
+
+/* Binary images.
+ ==============
+ A .p4b image is a program as p4_assembler leaves it, written by
+ p4_binary_write and loaded by p4_binary_load without parsing any text: a
+ header, the packed code, the predecoded (and fused) insn records and the
+ constant pool (cells maxstk + 1 .. OVERC). The constants are placed by the
+ assembler above the variable store and the code addresses them, so an image
+ only loads into a vm of the same maxstk, its pool grown to the size of the
+ image. Records are written as they are in
+ memory; the header holds their sizes and a vm built with other ones, or an
+ other byte order (magic), rejects the image.
+
+ The loader maps the file once, checks the header, the size of the file and
+ the code (valid), and copies the records into the vm. An image may come from
+ anywhere, so it is held to what the assembler produces:
+   - every packed instruction is a known opcode, its store operand (lod, ldo,
+     str, sro, lda, lao) in 0..maxstk, its constant (ldc, lca, chk) in the
+     pool and its target (ujp, fjp, xjp, cup) an instruction of insn;
+   - insn records, walked by their widths, are the packed instructions
+     expanded by p4_vm_decode, or fused instructions whose operands are held
+     to the same bounds;
+   - xjp follows the chk, ldc and sbi of a case statement, none of them a
+     target, and its table of ujp and ujc fits the bounds of the chk;
+   - the last instruction does not run past the code.
+ prd is left open after the image, so a program reads what follows it as its
+ prd, as it does after the code of an .asm file. p4_binary_maxstk reads the
+ store an image was placed for, to make its vm.
+ */
+
+#define P4B_MAGIC 0x42423450 // "P4BB" read in the byte order of the writer
+
+typedef struct p4b_header_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cell, code, insn; // bytes of rec_store_t, rec_code_t, rec_insn_t
+     int32_t maxstk;           // of the vm the constants were placed for
+     int32_t consts;           // cells of the constant pool
+    uint32_t codelen;          // instructions, (codelen + 1) / 2 code records
+    uint32_t fuse;             // FUSE_* sequences in insn
+} p4b_header_t;
+
+// the fields up to maxstk, the same in every image a vm can load
+static void format(p4b_header_t *h) {
+    memset(h, 0, sizeof(*h));
+    h->magic = P4B_MAGIC;
+    h->version = P4B_VERSION;
+    h->cell = sizeof(rec_store_t);
+    h->code = sizeof(rec_code_t);
+    h->insn = sizeof(rec_insn_t);
+} // format
+
+static void header(p4_vm_t p4vm, p4b_header_t *h) {
+    format(h);
+    h->maxstk = p4vm->maxstk;
+    h->consts = p4vm->consts;
+    h->codelen = p4vm->codelen;
+    h->fuse = p4vm->fuse;
+} // header
+
+// bytes of an image of codelen instructions and consts cells of constants
+static size_t length(uint32_t codelen, int32_t consts) {
+    return sizeof(p4b_header_t) + (codelen + 1) / 2 * sizeof(rec_code_t) + codelen * sizeof(rec_insn_t)
+            + (size_t) consts * sizeof(rec_store_t);
+} // length
+
+bool p4_binary_write(p4_vm_t p4vm, const char *name) {
+    p4b_header_t h;
+    FILE *f;
+    bool ok;
+
+    if ((f = fopen(name, "wb")) == NULL)
+        return false;
+    header(p4vm, &h);
+    ok = fwrite(&h, sizeof(h), 1, f) == 1
+            && fwrite(p4vm->code, sizeof(rec_code_t), (h.codelen + 1) / 2, f) == (h.codelen + 1) / 2
+            && fwrite(p4vm->insn, sizeof(rec_insn_t), h.codelen, f) == h.codelen
+            && fwrite(&(p4vm->store[p4vm->maxstk + 1]), sizeof(rec_store_t), h.consts, f) == (size_t) h.consts;
+    ok = (fclose(f) == 0) && ok;
+
+    return ok;
+} // p4_binary_write
+
+#define INVARS(h, q) ((q) >= 0 && (q) <= (h)->maxstk)                        // cell of the variable store
+#define INPOOL(h, q) ((q) > (h)->maxstk && (q) - (h)->maxstk <= (h)->consts) // cell of the constant pool
+
+static void fetch(const rec_code_t *code, uint32_t pc, uint8_t *op, uint8_t *p, int32_t *q) {
+    const rec_code_t *WITH = &(code[pc / 2]);
+
+    if (pc & 1) {
+        *op = WITH->op2;
+        *p = WITH->p2;
+        *q = WITH->q2;
+    } else {
+        *op = WITH->op1;
+        *p = WITH->p1;
+        *q = WITH->q1;
+    }
+} // fetch
+
+// op p q is an instruction of the assembler, its operand where the assembler places it
+static bool operand(const p4b_header_t *h, uint8_t op, uint8_t p, int32_t q) {
+    switch (op) {
+        case 0 ... 5:
+        case 65 ... 79:
+        case 105 ... 109: // lod, ldo, str, sro, lda, lao
+            return INVARS(h, q);
+
+        case 8:  // ldc of a real or a set
+        case 56: // lca
+            return INPOOL(h, q);
+
+        case 26:
+        case 96 ... 99: // chk, the bounds at q - 1 and q (chka, 95, checks a pointer)
+            return q > h->maxstk + 1 && INPOOL(h, q);
+
+        case 12: // cup
+        case 23: // ujp
+        case 24: // fjp
+        case 25: // xjp
+            return q >= 0 && (uint32_t) q < h->codelen;
+
+        case 15: // csp
+            return q >= 0 && q <= 22; // dsp, the last of sptable
+
+        case 17 ... 22: // equ..les, p the operand type
+            return p <= 6;
+    }
+    return op < OP_INCL;
+} // operand
+
+// the fused instruction at insn[0] keeps its operands in the bounds of the ones it covers
+static bool fused(const p4b_header_t *h, const rec_insn_t *insn, const bool *start) {
+    switch (insn->op) {
+        case OP_INCL:
+            return insn->p >= 0 && insn->p < DISPLAYMAX && INVARS(h, insn->q) && (insn->w == 3 || insn->w == 4);
+
+        case OP_INCO:
+            return INVARS(h, insn->q) && (insn->w == 3 || insn->w == 4);
+
+        case OP_IXAD:
+        case OP_IXLD:
+            return insn->p >= 0 && insn->p <= 3 && INVARS(h, insn->r) && insn->w >= 3
+                    && (insn[1].p == 0 || (insn[1].p > h->maxstk + 1 && INPOOL(h, insn[1].p)));
+
+        case OP_CMPJ ... OP_CMPJ + 5:
+            return insn->q >= 0 && (uint32_t) insn->q < h->codelen && start[insn->q] && insn->w == 2;
+
+        case OP_VARJ ... OP_CONJ + 5: // r is the variable VARJ compares with, the constant of CONJ
+            return insn->p >= 0 && insn->p <= 3 && INVARS(h, insn->q) && (insn->op >= OP_CONJ || INVARS(h, insn->r))
+                    && insn[1].q >= 0 && (uint32_t) insn[1].q < h->codelen && start[insn[1].q] && insn->w == 4;
+    }
+    return false;
+} // fused
+
+// xjp at pc jumps into a table of ujp and ujc checked by the case statement before it
+static bool table(const p4b_header_t *h, const rec_code_t *code, const rec_store_t *pool, const bool *start, const bool *target,
+        uint32_t pc) {
+    uint8_t op, p;
+    int32_t q, lo, hi, x;
+    int64_t i;
+
+    if (pc < 3 || target[pc - 2] || target[pc - 1] || target[pc])
+        return false;
+    fetch(code, pc - 3, &op, &p, &q);
+    if (op != 26) // chki
+        return false;
+    lo = pool[q - 1 - h->maxstk - 1].vi;
+    hi = pool[q - h->maxstk - 1].vi;
+    fetch(code, pc - 2, &op, &p, &q);
+    if (op != 7 || p != 1 || q != lo) // ldci lo
+        return false;
+    fetch(code, pc - 1, &op, &p, &q);
+    if (op != 30) // sbi
+        return false;
+    fetch(code, pc, &op, &p, &x);
+    if (lo > hi || (int64_t) hi - lo >= (int64_t) h->codelen - x)
+        return false;
+    for (i = x; i <= (int64_t) x + hi - lo; i++) {
+        fetch(code, i, &op, &p, &q);
+        if ((op != 23 && op != 61) || !start[i])
+            return false;
+    }
+    return true;
+} // table
+
+static bool valid(const p4b_header_t *h, const rec_code_t *code, const rec_insn_t *insn, const rec_store_t *pool) {
+    uint32_t pc, last = 0, n = h->codelen;
+    uint8_t op, p;
+    int32_t q;
+    bool *start, *target, ok = false;
+
+    if (n == 0 || (start = calloc(2 * (size_t) n, sizeof(bool))) == NULL)
+        return false;
+    target = start + n;
+
+    // insn records by their widths: decoded instructions and fused ones
+    for (pc = 0; pc < n; pc += insn[pc].w) {
+        if (insn[pc].op > OP_LAST || insn[pc].w == 0 || insn[pc].w > n - pc)
+            goto out;
+        start[pc] = true;
+        last = pc;
+    }
+
+    // packed instructions, as p4_vm_interpret runs them, and the insn records they decode to
+    for (pc = 0; pc < n; pc++) {
+        fetch(code, pc, &op, &p, &q);
+        if (!operand(h, op, p, q))
+            goto out;
+        switch (op) {
+            case 12:
+            case 23:
+            case 24:
+            case 25:
+                if (!start[q])
+                    goto out;
+                target[q] = true;
+                break;
+        }
+        if (!start[pc])
+            continue;
+        if (insn[pc].op >= OP_INCL && insn[pc].op < OP_RELOP) {
+            if (!fused(h, &(insn[pc]), start))
+                goto out;
+        } else if (insn[pc].w != 1 || insn[pc].p != p || insn[pc].q != q
+                || insn[pc].op != ((op >= 17 && op <= 22) ? OP_RELOP + 7 * (op - 17) + p : op))
+            goto out;
+    }
+
+    for (pc = 0; pc < n; pc++) {
+        fetch(code, pc, &op, &p, &q);
+        if (op == 25 && !table(h, code, pool, start, target, pc))
+            goto out;
+    }
+
+    // ret, ujp, stp or ujc
+    fetch(code, last, &op, &p, &q);
+    ok = insn[last].w == 1 && (op == 14 || op == 23 || op == 58 || op == 61);
+
+    out:
+    free(start);
+    return ok;
+} // valid
+
+int32_t p4_binary_maxstk(const char *name) {
+    p4b_header_t h, want;
+    FILE *f;
+    bool ok;
+
+    if ((f = fopen(name, "rb")) == NULL)
+        return -1;
+    ok = fread(&h, sizeof(h), 1, f) == 1;
+    fclose(f);
+    format(&want);
+    if (!ok || memcmp(&h, &want, offsetof(p4b_header_t, maxstk)) != 0 || h.maxstk <= PRRADR || h.maxstk > MAXSTK)
+        return -1;
+
+    return h.maxstk;
+} // p4_binary_maxstk
+
+bool p4_binary_load(p4_vm_t p4vm) {
+    p4b_header_t want;
+    const p4b_header_t *h;
+    const uint8_t *image;
+    struct stat st;
+    size_t code, insn;
+    bool ok = false;
+
+    if (p4vm->prd.f != NULL)
+        p4vm->prd.f = freopen(p4vm->prd.name, "rb", p4vm->prd.f);
+    else
+        p4vm->prd.f = fopen(p4vm->prd.name, "rb");
+    if (p4vm->prd.f == NULL || fstat(fileno(p4vm->prd.f), &st) != 0 || st.st_size < (off_t) sizeof(p4b_header_t))
+        return false;
+    if ((image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(p4vm->prd.f), 0)) == MAP_FAILED)
+        return false;
+
+    h = (const p4b_header_t*) image;
+    header(p4vm, &want);
+    want.codelen = h->codelen;
+    want.fuse = h->fuse;
+    want.consts = h->consts;
+    if (memcmp(h, &want, sizeof(want)) == 0 && h->codelen <= PCMAX && h->consts >= 0
+            && (size_t) st.st_size >= length(h->codelen, h->consts) && p4_vm_reserve(p4vm, h->codelen) && p4_vm_grow(p4vm, h->consts)) {
+        code = (h->codelen + 1) / 2 * sizeof(rec_code_t);
+        insn = h->codelen * sizeof(rec_insn_t);
+        if (valid(h, (const rec_code_t*) (image + sizeof(*h)), (const rec_insn_t*) (image + sizeof(*h) + code),
+                (const rec_store_t*) (image + sizeof(*h) + code + insn))) {
+            memcpy(p4vm->code, image + sizeof(*h), code);
+            memcpy(p4vm->insn, image + sizeof(*h) + code, insn);
+            memcpy(&(p4vm->store[p4vm->maxstk + 1]), image + sizeof(*h) + code + insn, (size_t) h->consts * sizeof(rec_store_t));
+            p4vm->codelen = h->codelen;
+            p4vm->fuse = h->fuse;
+            ok = fseek(p4vm->prd.f, length(h->codelen, h->consts), SEEK_SET) == 0;
+        }
+    }
+    munmap((void*) image, st.st_size);
+
+    return ok;
+} // p4_binary_load
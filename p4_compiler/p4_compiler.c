@@ -66,7 +66,7 @@
 #define SETLOW           0
 #define ORDMAXCHAR       63
 #define ORDMINCHAR       0
-#define MAXINT           32767
+#define MAXINT           2147483647
 #define LCAFTERMARKSTACK 5
 #define FILEAL           CHARAL
 #define MAXSTACK         1
@@ -184,8 +184,8 @@ typedef struct constant {
         char rval[STRGLGTH];
         setty pval;
         struct {
-            char slgth;
-            char sval[STRGLGTH];
+            long slgth;
+            char *sval; // slgth chars, string constants are not limited to STRGLGTH
         } U2;
     } UU;
 } constant_t;
@@ -203,7 +203,7 @@ typedef struct valu {
 /*****************/
 typedef uint8_t levrange;
 
-typedef short addrrange;
+typedef int32_t addrrange;
 
 typedef enum {
     scalar,
@@ -224,7 +224,7 @@ typedef enum {
 
 typedef struct structure {
     unsigned marked :1; /*for test phase only*/
-    unsigned size :15;
+    unsigned size :31;
     /* p2c: pcom.p, line 121: Note:
      * Field width for form assumes enum structform has 9 elements [105] */
     unsigned form :4;
@@ -245,6 +245,8 @@ typedef struct structure {
         struct structure *elset;
         struct {
             struct structure *aeltype, *inxtype;
+            addrrange lgth; /*number of elements*/
+            bool packed; /*declared packed, an array of char is then packed CHARCELL to a cell*/
         } U4;
         struct {
             struct identifier *fstfld;
@@ -297,7 +299,7 @@ typedef struct identifier {
             unsigned vkind :1;
             /* p2c: pcom.p, line 148:
              * Note: Field width for vkind assumes enum idkind has 2 elements [105] */
-            unsigned vlev :4, vaddr :15;
+            unsigned vlev :4, vaddr :31;
         } U2;
         unsigned fldaddr;
         struct {
@@ -490,11 +492,11 @@ static symbol_t ssy[256];
 /*nr. of res. words*/
 static operator_t rop[35];
 static operator_t sop[256];
-static alpha na[35];
-static char mn[61][4];
-static char sna[23][4];
-static signed char cdx[61];
-static signed char pdx[23];
+static alpha na[36];
+static char mn[64][4];
+static char sna[25][4];
+static signed char cdx[64];
+static signed char pdx[25];
 static long ordint[256];
 
 static long intlabel, mxint10, digmax;
@@ -634,7 +636,8 @@ static void insymbol(void) {
     struct LOC_insymbol V;
     long i, k;
     uint8_t digit[STRGLGTH];
-    char string[STRGLGTH];
+    char *string;
+    long size;
     constant_t *lvp;
     long FORLIM;
 
@@ -786,12 +789,17 @@ static void insymbol(void) {
             lgth = 0;
             sy = stringconst;
             op = noop;
+            string = NULL;
+            size = 0;
             do {
                 do {
                     nextch(&V);
                     lgth++;
-                    if (lgth <= STRGLGTH)
-                        string[lgth - 1] = ch;
+                    if (lgth > size) {
+                        size = (size == 0) ? STRGLGTH : 2 * size;
+                        string = realloc(string, size);
+                    }
+                    string[lgth - 1] = ch;
                 } while (!(eol || ch == '\''));
                 if (eol)
                     error(202);
@@ -807,17 +815,13 @@ static void insymbol(void) {
                 else {
                     lvp = malloc(sizeof(constant_t));
                     lvp->cclass = strg;
-                    if (lgth > STRGLGTH) {
-                        error(399);
-                        lgth = STRGLGTH;
-                    }
                     lvp->UU.U2.slgth = lgth;
-                    FORLIM = lgth;
-                    for (i = 0; i < FORLIM; i++)
-                        lvp->UU.U2.sval[i] = string[i];
+                    lvp->UU.U2.sval = string;
+                    string = NULL;
                     val.UU.valp = lvp;
                 }
             }
+            free(string);
             break;
 
         case chcolon:
@@ -961,7 +965,8 @@ static void searchid(setofids fidcls, identifier_t **fcp) {
     identifier_t *lcp;
 
     /*searchid*/
-    for (disx = top; disx >= 0; disx--) {
+    disx = top;
+    do { /*disx is unsigned*/
         lcp = display[disx].fname;
         while (lcp != NULL) {
             if (strncmp(lcp->name, id, sizeof(alpha))) {
@@ -977,7 +982,7 @@ static void searchid(setofids fidcls, identifier_t **fcp) {
                 error(103);
             lcp = lcp->rlink;
         }
-    }
+    } while (disx-- > 0);
     /*search not successful; suppress error message in case
      of forward referenced type id in pointer type definition
      --> procedure simpletype*/
@@ -1422,7 +1427,9 @@ static void constant_(long *fsys, structure_t **fsp, valu *fvalu, struct LOC_blo
                 lsp = malloc(sizeof(structure_t));
                 lsp->UU.U4.aeltype = charptr;
                 lsp->UU.U4.inxtype = NULL;
-                lsp->size = lgth;
+                lsp->UU.U4.lgth = lgth;
+                lsp->UU.U4.packed = true;
+                lsp->size = (lgth + CHARCELL - 1) / CHARCELL;
                 lsp->form = arrays;
             }
             *fvalu = val;
@@ -1561,7 +1568,7 @@ static bool comptypes(structure_t *fsp1, structure_t *fsp2, struct LOC_block *LI
 
                     case arrays:
                         comp = comptypes(fsp1->UU.U4.aeltype, fsp2->UU.U4.aeltype, LINK) & comptypes(fsp1->UU.U4.inxtype, fsp2->UU.U4.inxtype, LINK);
-                        Result = (comp && fsp1->size == fsp2->size) & equalbounds(fsp1->UU.U4.inxtype, fsp2->UU.U4.inxtype, LINK);
+                        Result = (comp && fsp1->size == fsp2->size && fsp1->UU.U4.lgth == fsp2->UU.U4.lgth && fsp1->UU.U4.packed == fsp2->UU.U4.packed) & equalbounds(fsp1->UU.U4.inxtype, fsp2->UU.U4.inxtype, LINK);
                         break;
 
                     case records:
@@ -1608,7 +1615,7 @@ static bool string(structure_t *fsp, struct LOC_block *LINK) {
     Result = false;
     if (fsp == NULL)
         return Result;
-    if (fsp->form == arrays) {
+    if (fsp->form == arrays && fsp->UU.U4.packed) {
         if (comptypes(fsp->UU.U4.aeltype, charptr, LINK))
             return true;
     }
@@ -1972,6 +1979,7 @@ static void typ(long *fsys, structure_t **fsp, addrrange *fsize, struct LOC_bloc
     identifier_t *lcp;
     addrrange lsize;
     long lmin, lmax;
+    bool lpacked;
     setofsys SET;
     _REC_display_t *WITH;
     long SET1[(long) ofsy / 32 + 2];
@@ -2022,7 +2030,8 @@ static void typ(long *fsys, structure_t **fsp, addrrange *fsize, struct LOC_bloc
                 } else
                     error(2);
             } else {
-                if (sy == packedsy) {
+                lpacked = (sy == packedsy);
+                if (lpacked) {
                     insymbol();
                     if (!p4_fn_inset(sy, typedels)) {
                         error(10);
@@ -2041,6 +2050,7 @@ static void typ(long *fsys, structure_t **fsp, addrrange *fsize, struct LOC_bloc
                         lsp = malloc(sizeof(structure_t));
                         lsp->UU.U4.aeltype = lsp1;
                         lsp->UU.U4.inxtype = NULL;
+                        lsp->UU.U4.packed = lpacked;
                         lsp->form = arrays;
                         lsp1 = lsp;
                         p4_fn_addset(p4_fn_expset(SET1, 0), (long) comma);
@@ -2085,7 +2095,11 @@ static void typ(long *fsys, structure_t **fsp, addrrange *fsize, struct LOC_bloc
                         if (lsp1->UU.U4.inxtype != NULL) {
                             getbounds(lsp1->UU.U4.inxtype, &lmin, &lmax);
                             align(lsp, &lsize);
-                            lsize *= lmax - lmin + 1;
+                            lsp1->UU.U4.lgth = lmax - lmin + 1;
+                            if (lpacked && comptypes(lsp, charptr, LINK))
+                                lsize = (lsp1->UU.U4.lgth + CHARCELL - 1) / CHARCELL;
+                            else
+                                lsize *= lsp1->UU.U4.lgth;
                             lsp1->size = lsize;
                         }
                         lsp = lsp1;
@@ -2825,9 +2839,7 @@ static void gen0(oprange fop, struct LOC_body *LINK) {
 }
 
 static void gen1(oprange fop, long fp2, struct LOC_body *LINK) {
-    long k;
     constant_t *WITH;
-    long FORLIM;
 
     /*gen1*/
     if (prcode) {
@@ -2842,11 +2854,7 @@ static void gen1(oprange fop, long fp2, struct LOC_body *LINK) {
             if (fop == 38) {
                 putc('\'', prr.f);
                 WITH = LINK->cstptr[fp2 - 1];
-                FORLIM = WITH->UU.U2.slgth;
-                for (k = 0; k < FORLIM; k++)
-                    putc(WITH->UU.U2.sval[k], prr.f);
-                for (k = WITH->UU.U2.slgth + 1; k <= STRGLGTH; k++)
-                    putc(' ', prr.f);
+                fwrite(WITH->UU.U2.sval, 1, WITH->UU.U2.slgth, prr.f);
                 fprintf(prr.f, "'\n");
             } else if (fop == 42)
                 fprintf(prr.f, "%c\n", (char) fp2);
@@ -2872,7 +2880,7 @@ static void gen2(oprange fop, long fp1, long fp2, struct LOC_body *LINK) {
             case 50:
             case 54:
             case 56:
-                fprintf(prr.f, " %3ld%8ld\n", fp1, fp2);
+                fprintf(prr.f, " %3ld %7ld\n", fp1, fp2);
                 break;
 
             case 47:
@@ -3011,7 +3019,7 @@ static void gen2t(oprange fop, long fp1, long fp2, structure_t *fsp, struct LOC_
         putic(LINK);
         fprintf(prr.f, "%.4s", mn[fop]);
         gentypindicator(fsp, LINK);
-        fprintf(prr.f, "%*ld%8ld\n", (labs(fp1) > 99) * 5 + 3, fp1, fp2);
+        fprintf(prr.f, "%*ld %7ld\n", (labs(fp1) > 99) * 5 + 3, fp1, fp2);
     }
     ic++;
     mes(fop, LINK);
@@ -3038,17 +3046,15 @@ static void _load(struct LOC_body *LINK) {
                 if (gattr.typtr == nilptr) /*ldc*/
                     gen2(51, 4, 0, LINK);
                 else {
-                    if (LINK->cstptrix >= cstoccmax)
-                        error(254);
-                    else {
-                        LINK->cstptrix++;
-                        LINK->cstptr[LINK->cstptrix - 1] = gattr.UU.cval.UU.valp;
-                        if (gattr.typtr == realptr) /*ldc*/
-                            gen2(51, 2, LINK->cstptrix, LINK);
-                        else
-                            /*ldc*/
-                            gen2(51, 5, LINK->cstptrix, LINK);
-                    }
+                    if (LINK->cstptrix >= cstoccmax) // gen wrote the constants out, their slots are free
+                        LINK->cstptrix = 0;
+                    LINK->cstptrix++;
+                    LINK->cstptr[LINK->cstptrix - 1] = gattr.UU.cval.UU.valp;
+                    if (gattr.typtr == realptr) /*ldc*/
+                        gen2(51, 2, LINK->cstptrix, LINK);
+                    else
+                        /*ldc*/
+                        gen2(51, 5, LINK->cstptrix, LINK);
                 }
             }
             break;
@@ -3068,8 +3074,8 @@ static void _load(struct LOC_body *LINK) {
                     gen1t(35, gattr.UU.U1.UU.idplmt, gattr.typtr, LINK);
                     break;
 
-                case inxd:
-                    error(400);
+                case inxd: /*ldb*/
+                    gen0(62, LINK);
                     break;
             }
             break;
@@ -3103,8 +3109,8 @@ static void _store(attr_t *fattr, struct LOC_body *LINK) {
                 gen0t(26, fattr->typtr, LINK);
             break;
 
-        case inxd:
-            error(400);
+        case inxd: /*stb*/
+            gen0(63, LINK);
             break;
     }
 }
@@ -3117,13 +3123,11 @@ static void loadaddress(struct LOC_body *LINK) {
 
         case cst:
             if (string(gattr.typtr, LINK->LINK)) {
-                if (LINK->cstptrix >= cstoccmax)
-                    error(254);
-                else {
-                    LINK->cstptrix++;
-                    LINK->cstptr[LINK->cstptrix - 1] = gattr.UU.cval.UU.valp; /*lca*/
-                    gen1(38, LINK->cstptrix, LINK);
-                }
+                if (LINK->cstptrix >= cstoccmax) // gen wrote the constants out, their slots are free
+                    LINK->cstptrix = 0;
+                LINK->cstptrix++;
+                LINK->cstptr[LINK->cstptrix - 1] = gattr.UU.cval.UU.valp; /*lca*/
+                gen1(38, LINK->cstptrix, LINK);
             } else
                 error(400);
             break;
@@ -3145,8 +3149,8 @@ static void loadaddress(struct LOC_body *LINK) {
                     break;
 
                 case inxd:
-                    error(400);
-                    break;
+                    /*the byte address is on the stack already (ldb, stb, rdb)*/
+                    return;
             }
             break;
 
@@ -3330,7 +3334,11 @@ static void selector(long *fsys, identifier_t *fcp, struct LOC_statement *LINK)
                     gattr.kind = varbl;
                     gattr.UU.U1.access = indrct;
                     gattr.UU.U1.UU.idplmt = 0;
-                    if (gattr.typtr != NULL) {
+                    if (string(lattr.typtr, LINK->LINK->LINK)) {
+                        /*byte address of a packed char*/
+                        gattr.UU.U1.access = inxd; /*ixb*/
+                        gen0(61, LINK->LINK);
+                    } else if (gattr.typtr != NULL) {
                         lsize = gattr.typtr->size;
                         align(gattr.typtr, &lsize); /*ixa*/
                         gen1(36, lsize, LINK->LINK);
@@ -3456,6 +3464,7 @@ static void read(struct LOC_call *LINK) {
     levrange llev;
     addrrange laddr;
     structure_t *lsp;
+    bool packed;
     setofsys SET, SET1;
 
     /*read*/
@@ -3492,6 +3501,7 @@ static void read(struct LOC_call *LINK) {
         }
         if (!LINK->LINK->LINK->LINK->test) {
             do {
+                packed = (gattr.kind == varbl && gattr.UU.U1.access == inxd);
                 loadaddress(LINK->LINK->LINK); /*lda*/
                 gen2(50, level - llev, laddr, LINK->LINK->LINK);
                 if (gattr.typtr != NULL) {
@@ -3506,10 +3516,10 @@ static void read(struct LOC_call *LINK) {
                             else {
                                 if (comptypes(charptr, gattr.typtr, LINK->LINK->LINK->LINK))
                                     /*csp*/
-                                    gen1(30, 5, LINK->LINK->LINK);
+                                    gen1(30, packed ? 24 : 5, LINK->LINK->LINK);
                                 else
                                     error(399);
-                                /*rdc*/
+                                /*rdc, rdb*/
                             }
                             /*rdr*/
                         }
@@ -3641,7 +3651,7 @@ static void write(struct LOC_call *LINK) {
                                         error(399);
                                     else {
                                         if (string(lsp, LINK->LINK->LINK->LINK)) {
-                                            len = lsp->size;
+                                            len = lsp->UU.U4.lgth;
                                             if (default_) /*ldc*/
                                                 gen2(51, 1, len, LINK->LINK->LINK);
                                             /*ldc*/
@@ -3840,6 +3850,27 @@ static void new_(struct LOC_call *LINK) {
     gen1(30, 12, LINK->LINK->LINK);
 }
 
+static void dispose_(struct LOC_call *LINK) {
+    structure_t *lsp;
+    valu lval;
+    setofsys SET, SET1;
+
+    /*dispose*/
+    variable(p4_fn_setunion(SET1, LINK->fsys, p4_fn_expset(SET, (1L << ((long) comma)) | (1L << ((long) rparent)))), LINK);
+    if (gattr.typtr != NULL) {
+        if (gattr.typtr->form != pointer)
+            error(116);
+    }
+    _load(LINK->LINK->LINK);
+    while (sy == comma) {
+        /*tagfield values of new, the block knows its size*/
+        insymbol();
+        constant_(p4_fn_setunion(SET1, LINK->fsys, p4_fn_expset(SET, (1L << ((long) comma)) | (1L << ((long) rparent)))), &lsp, &lval, LINK->LINK->LINK->LINK);
+    }
+    /*csp dsp*/
+    gen1(30, 25, LINK->LINK->LINK);
+}
+
 static void mark__(struct LOC_call *LINK) {
     setofsys SET, SET1;
 
@@ -4067,6 +4098,8 @@ static void callnonstandard(struct LOC_call *LINK) {
                                     }
                                 } else {
                                     if (gattr.kind == varbl) {
+                                        if (gattr.UU.U1.access == inxd)
+                                            error(399); /*packed char*/
                                         loadaddress(LINK->LINK->LINK);
                                         locpar += PTRSIZE;
                                         align(parmptr, &locpar);
@@ -4163,6 +4196,10 @@ static void call(long *fsys_, identifier_t *fcp_, struct LOC_statement *LINK) {
             case 13:
                 mark__(&V);
                 break;
+
+            case 14:
+                dispose_(&V);
+                break;
         }
         if (((1L << V.lkey) & 0x1860) != 0)
             return;
@@ -4309,7 +4346,9 @@ static void factor(long *fsys, struct LOC_term *LINK) {
                     lsp->UU.U4.aeltype = charptr;
                     lsp->form = arrays;
                     lsp->UU.U4.inxtype = NULL;
-                    lsp->size = lgth;
+                    lsp->UU.U4.lgth = lgth;
+                    lsp->UU.U4.packed = true;
+                    lsp->size = (lgth + CHARCELL - 1) / CHARCELL;
                     gattr.typtr = lsp;
                 }
                 gattr.kind = cst;
@@ -4402,17 +4441,15 @@ static void factor(long *fsys, struct LOC_term *LINK) {
                         lvp = malloc(sizeof(constant_t));
                         p4_fn_setcpy(lvp->UU.pval, cstpart);
                         lvp->cclass = pset;
-                        if (LINK->LINK->LINK->LINK->LINK->cstptrix == cstoccmax)
-                            error(254);
-                        else {
-                            LINK->LINK->LINK->LINK->LINK->cstptrix++;
-                            LINK->LINK->LINK->LINK->LINK->cstptr[LINK->LINK->LINK->LINK->LINK->cstptrix - 1] = lvp;
-                            /*ldc*/
-                            gen2(51, 5, LINK->LINK->LINK->LINK->LINK->cstptrix, LINK->LINK->LINK->LINK->LINK);
-                            /*uni*/
-                            gen0(28, LINK->LINK->LINK->LINK->LINK);
-                            gattr.kind = expr;
-                        }
+                        if (LINK->LINK->LINK->LINK->LINK->cstptrix == cstoccmax) // gen wrote the constants out, their slots are free
+                            LINK->LINK->LINK->LINK->LINK->cstptrix = 0;
+                        LINK->LINK->LINK->LINK->LINK->cstptrix++;
+                        LINK->LINK->LINK->LINK->LINK->cstptr[LINK->LINK->LINK->LINK->LINK->cstptrix - 1] = lvp;
+                        /*ldc*/
+                        gen2(51, 5, LINK->LINK->LINK->LINK->LINK->cstptrix, LINK->LINK->LINK->LINK->LINK);
+                        /*uni*/
+                        gen0(28, LINK->LINK->LINK->LINK->LINK);
+                        gattr.kind = expr;
                     }
                     /* p2c: pcom.p, line 2875:
                      * Note: No SpecialMalloc form known for CONSTANT.PSET [187] */
@@ -4747,6 +4784,7 @@ static void expression(long *fsys, struct LOC_statement *LINK) {
                         if (!string(lattr.typtr, LINK->LINK->LINK))
                             error(134);
                         typind = 'm';
+                        lsize = lattr.typtr->UU.U4.lgth;
                         break;
 
                     case records:
@@ -5675,6 +5713,7 @@ static void stdnames(void) {
     memcpy(na[32], "prd     ", sizeof(alpha));
     memcpy(na[33], "prr     ", sizeof(alpha));
     memcpy(na[34], "mark    ", sizeof(alpha));
+    memcpy(na[35], "dispose ", sizeof(alpha));
 }
 
 static void enterstdtypes(void) { /*type underlying:*/
@@ -5841,6 +5880,14 @@ static void entstdnames(void) { /*name:*/
     cp->klass = proc;
     cp->UU.U4.pfdeckind = standard;
     enterid(cp);
+    cp = malloc(sizeof(identifier_t));
+    memcpy(cp->name, na[35], sizeof(alpha));
+    cp->idtype = NULL;
+    cp->next = NULL;
+    cp->UU.U4.UU.key = 14; /*dispose*/
+    cp->klass = proc;
+    cp->UU.U4.pfdeckind = standard;
+    enterid(cp);
     for (i = 17; i <= 26; i++) {
         cp = malloc(sizeof(identifier_t)); /*abs,sqr,trunc*/
         /*odd,ord,chr*/
@@ -6160,6 +6207,8 @@ static void procmnemonics(void) {
     memcpy(sna[20], " rln", 4);
     memcpy(sna[21], " wln", 4);
     memcpy(sna[22], " sav", 4);
+    memcpy(sna[23], " rdb", 4);
+    memcpy(sna[24], " dsp", 4);
 }
 
 static void instrmnemonics(void) {
@@ -6225,6 +6274,9 @@ static void instrmnemonics(void) {
     memcpy(mn[58], " ord", 4);
     memcpy(mn[59], " chr", 4);
     memcpy(mn[60], " ujc", 4);
+    memcpy(mn[61], " ixb", 4);
+    memcpy(mn[62], " ldb", 4);
+    memcpy(mn[63], " stb", 4);
 }
 
 static void chartypes(void) {
@@ -6361,6 +6413,9 @@ static void initdx(void) {
     cdx[58] = 0;
     cdx[59] = 0;
     cdx[60] = 0;
+    cdx[61] = -1;
+    cdx[62] = 0;
+    cdx[63] = -2;
     pdx[0] = -1;
     pdx[1] = -1;
     pdx[2] = -2;
@@ -6384,6 +6439,8 @@ static void initdx(void) {
     pdx[20] = -1;
     pdx[21] = -1;
     pdx[22] = -1;
+    pdx[23] = -2;
+    pdx[24] = -1;
 }
 
 static void inittables(void) {
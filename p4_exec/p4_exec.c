@@ -0,0 +1,321 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "p4_vm.h"
+#include "p4_assembler.h"
+#include "p4_binary.h"
+#include "p4_file.h"
+#include "p4_exec.h"
+
+/* Job executor.
+ ==============
+ p4_exec runs jobs (program image, input file, output file) on a fixed pool of
+ worker threads, each one with its own vm. A program is assembled once by
+ p4_exec_load and every job runs in a copy on write clone of the image
+ (p4_vm_clone), so jobs of the same program share its pages but not their
+ writes. The program reads the job input as input and writes the job output as
+ output; prd is empty and prr is discarded.
+
+ Submitted jobs are dealt to the workers in turn. A worker runs the jobs of its
+ own queue last in first out and, when it is empty, steals the oldest job of
+ another queue, so a worker left behind by a long job loses its queue to the
+ idle ones.
+ */
+
+static bool push(p4_queue_t *q, p4_job_t *job) {
+    p4_job_t **ring;
+    uint32_t n;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail - q->head == q->size) {
+        if ((ring = malloc(2 * q->size * sizeof(p4_job_t*))) == NULL) {
+            pthread_mutex_unlock(&q->lock);
+            return false;
+        }
+        for (n = 0; n < q->size; n++)
+            ring[n] = q->job[(q->head + n) % q->size];
+        free(q->job);
+        q->job = ring;
+        __atomic_store_n(&q->head, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&q->tail, q->size, __ATOMIC_RELAXED);
+        q->size *= 2;
+    }
+    q->job[q->tail % q->size] = job;
+    __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->lock);
+
+    return true;
+} // push
+
+// own queue: newest job
+static p4_job_t* pop(p4_queue_t *q) {
+    p4_job_t *job = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail != q->head) {
+        job = q->job[(q->tail - 1) % q->size];
+        __atomic_store_n(&q->tail, q->tail - 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return job;
+} // pop
+
+// queue of another worker: oldest job
+static p4_job_t* steal(p4_queue_t *q) {
+    p4_job_t *job = NULL;
+
+    // unlocked peek, a stale answer only delays the steal
+    if (__atomic_load_n(&q->tail, __ATOMIC_RELAXED) == __atomic_load_n(&q->head, __ATOMIC_RELAXED))
+        return NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail != q->head) {
+        job = q->job[q->head % q->size];
+        __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return job;
+} // steal
+
+static p4_job_t* take(p4_exec_t ex, p4_worker_t *w) {
+    p4_job_t *job;
+    uint32_t n;
+
+    if ((job = pop(&w->queue)) == NULL)
+        for (n = 1; n < ex->nworker && job == NULL; n++)
+            job = steal(&ex->worker[(w->id + n) % ex->nworker].queue);
+    if (job != NULL)
+        __atomic_fetch_sub(&ex->queued, 1, __ATOMIC_RELAXED);
+
+    return job;
+} // take
+
+static uint8_t execute(p4_worker_t *w, p4_job_t *job) {
+    uint8_t status = EXECFILE;
+    p4_vm_t vm;
+
+    if ((vm = w->vm = p4_vm_clone(job->image)) == NULL)
+        return EXECCLONE;
+    vm->input.f = (job->input != NULL) ? fopen(job->input, "r") : tmpfile();
+    vm->output.f = (job->output != NULL) ? fopen(job->output, "w") : tmpfile();
+    vm->prd.f = tmpfile();
+    vm->prr.f = tmpfile();
+
+    if (vm->input.f != NULL && vm->output.f != NULL && vm->prd.f != NULL && vm->prr.f != NULL) {
+        vm->pc = 0;
+        vm->sp = -1;
+        vm->mp = 0;
+        vm->np = vm->maxstk + 1;
+        vm->ep = 5;
+        vm->lv = 0;
+        vm->display[0] = 0;
+
+        vm->store[INPUTADR].vc = ' ';
+        vm->store[PRDADR].vc = p4_file_peek(vm->prd.f);
+        vm->run = true;
+
+        status = p4_vm_run(vm);
+    }
+
+    if (vm->input.f != NULL)
+        fclose(vm->input.f);
+    if (vm->output.f != NULL)
+        fclose(vm->output.f);
+    if (vm->prd.f != NULL)
+        fclose(vm->prd.f);
+    if (vm->prr.f != NULL)
+        fclose(vm->prr.f);
+    p4_vm_free(vm);
+    w->vm = NULL;
+
+    return status;
+} // execute
+
+static void* worker(void *arg) {
+    p4_worker_t *w = arg;
+    p4_exec_t ex = w->ex;
+    p4_job_t *job;
+
+    for (;;) {
+        if ((job = take(ex, w)) == NULL) {
+            pthread_mutex_lock(&ex->lock);
+            while (__atomic_load_n(&ex->queued, __ATOMIC_RELAXED) == 0 && !ex->stop)
+                pthread_cond_wait(&ex->work, &ex->lock);
+            if (ex->stop && __atomic_load_n(&ex->queued, __ATOMIC_RELAXED) == 0) {
+                pthread_mutex_unlock(&ex->lock);
+                break;
+            }
+            pthread_mutex_unlock(&ex->lock);
+            continue;
+        }
+
+        job->status = execute(w, job);
+
+        pthread_mutex_lock(&ex->lock);
+        if (--ex->pending == 0)
+            pthread_cond_broadcast(&ex->done);
+        pthread_mutex_unlock(&ex->lock);
+    }
+
+    return NULL;
+} // worker
+
+// assembles a program (or loads its .p4b image) once for the jobs that run it, with a variable store of maxstk cells
+// (an image keeps the store it was written for)
+p4_vm_t p4_exec_load(const char *name, int32_t maxstk) {
+    p4_vm_t image;
+    size_t len = strlen(name);
+    bool p4b = len > 4 && strcmp(name + len - 4, ".p4b") == 0;
+
+    if (p4b && (maxstk = p4_binary_maxstk(name)) < 0)
+        return NULL;
+    if (len >= sizeof(image->prd.name) || (image = p4_vm_new(maxstk)) == NULL)
+        return NULL;
+
+    image->prd.f = NULL;
+    image->prr.f = NULL;
+    image->input.f = NULL;
+    image->output.f = NULL;
+    strcpy(image->prd.name, name);
+    image->fuse = FUSE_ALL;
+    if (!(p4b ? p4_binary_load(image) : p4_assembler(image))) {
+        if (image->prd.f != NULL)
+            fclose(image->prd.f);
+        p4_vm_free(image);
+        return NULL;
+    }
+    fclose(image->prd.f);
+    image->prd.f = NULL;
+
+    return image;
+} // p4_exec_load
+
+p4_exec_t p4_exec_new(uint32_t workers) {
+    p4_exec_t ex;
+    p4_worker_t *w;
+    uint32_t n;
+
+    if (workers == 0 || (ex = calloc(1, sizeof(struct p4_exec_s))) == NULL)
+        return NULL;
+    if ((ex->worker = calloc(workers, sizeof(p4_worker_t))) == NULL) {
+        free(ex);
+        return NULL;
+    }
+    pthread_mutex_init(&ex->lock, NULL);
+    pthread_cond_init(&ex->work, NULL);
+    pthread_cond_init(&ex->done, NULL);
+
+    // every worker is set up before the first one runs and looks at the others
+    for (n = 0; n < workers; n++) {
+        w = &ex->worker[n];
+        w->id = n;
+        w->queue.size = EXECQUEUE;
+        pthread_mutex_init(&w->queue.lock, NULL);
+        ex->nworker++;
+        if ((w->queue.job = malloc(EXECQUEUE * sizeof(p4_job_t*))) == NULL) {
+            p4_exec_free(ex);
+            return NULL;
+        }
+    }
+
+    // w->ex marks a running worker
+    for (n = 0; n < workers; n++) {
+        w = &ex->worker[n];
+        w->ex = ex;
+        if (pthread_create(&w->thread, NULL, worker, w) != 0) {
+            w->ex = NULL;
+            p4_exec_free(ex);
+            return NULL;
+        }
+    }
+
+    return ex;
+} // p4_exec_new
+
+bool p4_exec_submit(p4_exec_t ex, p4_job_t *job) {
+    uint32_t n;
+
+    pthread_mutex_lock(&ex->lock);
+    n = ex->next++ % ex->nworker;
+    __atomic_fetch_add(&ex->queued, 1, __ATOMIC_RELAXED);
+    if (!push(&ex->worker[n].queue, job)) {
+        __atomic_fetch_sub(&ex->queued, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&ex->lock);
+        return false;
+    }
+    ex->pending++;
+    pthread_cond_signal(&ex->work);
+    pthread_mutex_unlock(&ex->lock);
+
+    return true;
+} // p4_exec_submit
+
+// waits until every submitted job is done
+void p4_exec_wait(p4_exec_t ex) {
+    pthread_mutex_lock(&ex->lock);
+    while (ex->pending != 0)
+        pthread_cond_wait(&ex->done, &ex->lock);
+    pthread_mutex_unlock(&ex->lock);
+} // p4_exec_wait
+
+// runs the queued jobs and stops the workers
+void p4_exec_free(p4_exec_t ex) {
+    p4_worker_t *w;
+    uint32_t n;
+
+    pthread_mutex_lock(&ex->lock);
+    ex->stop = true;
+    pthread_cond_broadcast(&ex->work);
+    pthread_mutex_unlock(&ex->lock);
+
+    for (n = 0; n < ex->nworker; n++) {
+        w = &ex->worker[n];
+        if (w->ex != NULL)
+            pthread_join(w->thread, NULL);
+        free(w->queue.job);
+        pthread_mutex_destroy(&w->queue.lock);
+    }
+    pthread_cond_destroy(&ex->done);
+    pthread_cond_destroy(&ex->work);
+    pthread_mutex_destroy(&ex->lock);
+    free(ex->worker);
+    free(ex);
+} // p4_exec_free
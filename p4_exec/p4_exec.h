@@ -0,0 +1,88 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef P4_EXEC_H_
+#define P4_EXEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "p4_vm.h"
+
+#define EXECQUEUE 64  // initial jobs in the queue of a worker
+#define EXECFILE  252 // status of a job whose files could not be opened
+#define EXECCLONE 253 // status of a job whose clone of the image could not be made
+
+typedef struct p4_job_s {
+        p4_vm_t image;   // program loaded by p4_exec_load (p4_vm_free), cloned by its jobs
+     const char *input;  // file read by the program as input, NULL for an empty input
+     const char *output; // file written by the program as output, NULL to discard it
+        uint8_t status;  // when done: 255, the failing op, VMFAULT, EXECFILE or EXECCLONE
+} p4_job_t;
+
+// jobs of a worker: the worker takes from the tail, other workers steal from the head
+typedef struct p4_queue_s {
+    pthread_mutex_t lock;
+          p4_job_t **job; // ring of size entries
+           uint32_t head, tail, size;
+} p4_queue_t;
+
+typedef struct p4_worker_s {
+    struct p4_exec_s *ex;
+           pthread_t thread;
+             p4_vm_t vm;    // clone running the current job, NULL when idle
+          p4_queue_t queue;
+            uint32_t id;
+} p4_worker_t;
+
+typedef struct p4_exec_s {
+       p4_worker_t *worker;
+          uint32_t nworker;
+          uint32_t next;    // worker receiving the next job
+   pthread_mutex_t lock;
+    pthread_cond_t work;    // a job was queued or the executor stops
+    pthread_cond_t done;    // no job is pending
+          uint32_t queued;  // jobs in the queues
+          uint32_t pending; // jobs submitted and not done
+              bool stop;
+} *p4_exec_t;
+
+  p4_vm_t p4_exec_load(const char *name, int32_t maxstk);
+p4_exec_t p4_exec_new(uint32_t workers);
+     bool p4_exec_submit(p4_exec_t ex, p4_job_t *job);
+     void p4_exec_wait(p4_exec_t ex);
+     void p4_exec_free(p4_exec_t ex);
+
+#endif /* P4_EXEC_H_ */
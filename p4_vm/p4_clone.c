@@ -0,0 +1,351 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "p4_vm.h"
+
+/* Cloning.
+ ========
+ A vm made by p4_vm_new lives in a memory file mapped shared, and its program
+ (code and insn) in an image of its own. Once loaded it is a template:
+ p4_vm_clone maps the same file private, so a clone costs a mapping and shares
+ every page of the template (registers, store, constants) until it writes it;
+ only the pages it writes are copied. The image is not copied at all: a clone
+ points at the image of the template, which counts the vms using it and goes
+ with the last of them, so the template may be freed before its clones. The
+ first clone makes the image read only. The template must not be changed
+ while it has clones, since a clone sees the template pages it has not
+ written yet. Without memory files (not Linux) a clone is a copy that still
+ shares the image.
+
+ The code and insn of an image share a block of their own, which
+ p4_vm_reserve replaces by a larger one (twice the instructions at least) as
+ the assembler fills it, so the length of a program is not fixed; the vm is
+ pointed at the new block, and an image with clones no longer grows.
+
+ The pages of the file are zero until first written, so a large store costs
+ nothing until the program uses it. Every mapping sits in a PROT_NONE
+ reservation, never backed, of P4_VM_GUARD bytes before the vm and twice its
+ room (P4_VM_ROOM, the size it can grow to) from its start (P4_VM_REACH). The
+ addresses a program computes are checked against the store, the frames ret
+ returns to as well, so only an operand of the code (an offset from a frame,
+ at most a store long, p4_assembler) runs off it: such an access lands in a
+ guard and faults (p4_vm_run turns the fault into VMFAULT) instead of reaching
+ other memory. Vms of HUGESTORE bytes and more are aligned to HUGEPAGE and
+ advised as huge pages (MADV_HUGEPAGE, used where shmem huge pages are
+ enabled) to take fewer TLB misses on large arrays.
+
+ The constant pool is the end of the vm, p4_vm_grow makes it larger in place
+ while a program is loaded and before it is cloned: the file grows and the new
+ pages are mapped over the guard that follows the vm, reserved for a pool of
+ CONSTMAX cells (a clone only has the room of its own pool). Without memory
+ files the pool is allocated at its largest (CONSTMAX).
+ */
+
+#define TEXTALIGN 64 // of code and insn in their block
+
+#if defined(__linux__)
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define HUGEPAGE  (2 << 20) // stores of at least HUGESTORE bytes are aligned to it
+#define HUGESTORE (4 * HUGEPAGE)
+
+// zeroed block of code and insn, page aligned
+static void* text_new(size_t bytes) {
+    void *text;
+
+    if ((text = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        return NULL;
+    return text;
+} // text_new
+
+static void text_free(void *text, size_t bytes) {
+    munmap(text, bytes);
+} // text_free
+
+static void text_seal(void *text, size_t bytes) {
+    mprotect(text, bytes, PROT_READ);
+} // text_seal
+
+#else
+
+static void* text_new(size_t bytes) {
+    void *text;
+
+    if ((text = aligned_alloc(TEXTALIGN, bytes)) != NULL)
+        memset(text, 0, bytes);
+    return text;
+} // text_new
+
+static void text_free(void *text, size_t bytes) {
+    (void) bytes;
+    free(text);
+} // text_free
+
+static void text_seal(void *text, size_t bytes) {
+    // the text stays writable, there is no mprotect
+    (void) text;
+    (void) bytes;
+} // text_seal
+
+#endif
+
+// bytes of the code records of size instructions, insn follows them
+static size_t codebytes(uint32_t size) {
+    return ((size + 1) / 2 * sizeof(rec_code_t) + TEXTALIGN - 1) & ~(size_t) (TEXTALIGN - 1);
+} // codebytes
+
+static size_t textbytes(uint32_t size) {
+    return codebytes(size) + (size_t) size * sizeof(rec_insn_t);
+} // textbytes
+
+static p4_image_t image_new(uint32_t size) {
+    p4_image_t image;
+
+    if ((image = malloc(sizeof(struct p4_image_s))) == NULL)
+        return NULL;
+    if ((image->code = text_new(textbytes(size))) == NULL) {
+        free(image);
+        return NULL;
+    }
+    image->insn = (rec_insn_t*) ((uint8_t*) image->code + codebytes(size));
+    image->size = size;
+    image->refs = 1;
+
+    return image;
+} // image_new
+
+// one more vm runs the image, the first clone seals code and insn (refs stays writable)
+static void image_ref(p4_image_t image) {
+    if (__atomic_fetch_add(&(image->refs), 1, __ATOMIC_ACQ_REL) == 1)
+        text_seal(image->code, textbytes(image->size));
+} // image_ref
+
+static void image_free(p4_image_t image) {
+    if (__atomic_sub_fetch(&(image->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+        text_free(image->code, textbytes(image->size));
+        free(image);
+    }
+} // image_free
+
+// code and insn move to a block of twice the instructions at least
+bool p4_vm_reserve(p4_vm_t p4vm, uint32_t len) {
+    p4_image_t image = p4vm->image;
+    uint32_t size = (image->size > PCMAX / 2) ? PCMAX : 2 * image->size;
+    rec_code_t *code;
+
+    if (len <= image->size)
+        return true;
+    if (len > PCMAX || image->refs != 1)
+        return false;
+    if (size < len)
+        size = len;
+    if ((code = text_new(textbytes(size))) == NULL)
+        return false;
+    memcpy(code, image->code, (image->size + 1) / 2 * sizeof(rec_code_t));
+    memcpy((uint8_t*) code + codebytes(size), image->insn, (size_t) image->size * sizeof(rec_insn_t));
+    text_free(image->code, textbytes(image->size));
+    image->code = code;
+    image->insn = (rec_insn_t*) ((uint8_t*) code + codebytes(size));
+    image->size = size;
+    p4vm->code = image->code;
+    p4vm->insn = image->insn;
+
+    return true;
+} // p4_vm_reserve
+
+#if defined(__linux__)
+
+// bytes mapped for a vm, whole pages
+static size_t span(int32_t maxstk, int32_t consts) {
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return (P4_VM_SIZE(maxstk, consts) + page - 1) & ~(page - 1);
+} // span
+
+// maps the vm file in its reservation, P4_VM_GUARD before and reach bytes from the vm (P4_VM_REACH)
+static p4_vm_t place(int fd, int32_t maxstk, int32_t consts, size_t reach, int flags) {
+    size_t page = sysconf(_SC_PAGESIZE), size = span(maxstk, consts), align = (size >= HUGESTORE) ? HUGEPAGE : page;
+    size_t total = P4_VM_GUARD + reach + align;
+    uint8_t *base, *vm;
+
+    if ((base = mmap(NULL, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED)
+        return NULL;
+    vm = (uint8_t*) (((uintptr_t) base + P4_VM_GUARD + align - 1) & ~(align - 1));
+    if (vm - P4_VM_GUARD > base)
+        munmap(base, vm - P4_VM_GUARD - base);
+    if (base + total > vm + reach)
+        munmap(vm + reach, base + total - (vm + reach));
+
+    if (mmap(vm, size, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(vm - P4_VM_GUARD, P4_VM_GUARD + reach);
+        return NULL;
+    }
+    if (align == HUGEPAGE)
+        madvise(vm, size, MADV_HUGEPAGE);
+
+    return (p4_vm_t) vm;
+} // place
+
+p4_vm_t p4_vm_new(int32_t maxstk) {
+    p4_vm_t p4vm;
+    size_t reach;
+    int fd;
+
+    if (maxstk > MAXSTK)
+        return NULL;
+    if ((fd = memfd_create("p4_vm", MFD_CLOEXEC)) < 0)
+        return NULL;
+    reach = 2 * P4_VM_ROOM(maxstk, CONSTMAX);
+    if (ftruncate(fd, span(maxstk, CONSTPOOL)) != 0 || (p4vm = place(fd, maxstk, CONSTPOOL, reach, MAP_SHARED)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+    if ((p4vm->image = image_new(CODELEN)) == NULL) {
+        close(fd);
+        munmap((uint8_t*) p4vm - P4_VM_GUARD, P4_VM_GUARD + reach);
+        return NULL;
+    }
+    p4vm->code = p4vm->image->code;
+    p4vm->insn = p4vm->image->insn;
+    p4vm->fd = fd;
+    p4vm->maxstk = maxstk;
+    p4vm->consts = CONSTPOOL;
+    p4vm->jit = NULL;
+    p4vm->gc = false;
+    p4vm->gcleft = 0;
+
+    return p4vm;
+} // p4_vm_new
+
+// the file of the vm grows and its new pages are mapped where the guard after the vm begins
+bool p4_vm_grow(p4_vm_t p4vm, int32_t consts) {
+    size_t from = span(p4vm->maxstk, p4vm->consts), to;
+
+    if (consts <= p4vm->consts)
+        return true;
+    if (consts > CONSTMAX || p4vm->fd < 0 || p4vm->image->refs != 1)
+        return false;
+    to = span(p4vm->maxstk, consts);
+    if (to > from && (ftruncate(p4vm->fd, to) != 0
+            || mmap((uint8_t*) p4vm + from, to - from, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, p4vm->fd, from) == MAP_FAILED))
+        return false;
+    p4vm->consts = consts;
+
+    return true;
+} // p4_vm_grow
+
+p4_vm_t p4_vm_clone(p4_vm_t p4vm) {
+    p4_vm_t clone;
+
+    if ((clone = place(p4vm->fd, p4vm->maxstk, p4vm->consts, 2 * P4_VM_ROOM(p4vm->maxstk, p4vm->consts), MAP_PRIVATE)) == NULL)
+        return NULL;
+    image_ref(p4vm->image);
+    clone->fd = -1;
+    clone->jit = NULL;
+
+    return clone;
+} // p4_vm_clone
+
+void p4_vm_free(p4_vm_t p4vm) {
+    size_t reach = P4_VM_REACH(p4vm);
+
+    image_free(p4vm->image);
+    if (p4vm->fd >= 0)
+        close(p4vm->fd);
+    munmap((uint8_t*) p4vm - P4_VM_GUARD, P4_VM_GUARD + reach);
+} // p4_vm_free
+
+#else
+
+p4_vm_t p4_vm_new(int32_t maxstk) {
+    p4_vm_t p4vm;
+
+    if (maxstk > MAXSTK || (p4vm = malloc(P4_VM_SIZE(maxstk, CONSTMAX))) == NULL)
+        return NULL;
+    if ((p4vm->image = image_new(CODELEN)) == NULL) {
+        free(p4vm);
+        return NULL;
+    }
+    p4vm->code = p4vm->image->code;
+    p4vm->insn = p4vm->image->insn;
+    memset(p4vm->heap, 0, sizeof(p4vm->heap));
+    p4vm->fd = -1;
+    p4vm->maxstk = maxstk;
+    p4vm->consts = CONSTPOOL;
+    p4vm->jit = NULL;
+    p4vm->gc = false;
+    p4vm->gcleft = 0;
+
+    return p4vm;
+} // p4_vm_new
+
+// the pool was allocated at its largest, but clones are copied at their size and share the image
+bool p4_vm_grow(p4_vm_t p4vm, int32_t consts) {
+    if (consts <= p4vm->consts)
+        return true;
+    if (consts > CONSTMAX || p4vm->image->refs != 1)
+        return false;
+    p4vm->consts = consts;
+
+    return true;
+} // p4_vm_grow
+
+p4_vm_t p4_vm_clone(p4_vm_t p4vm) {
+    p4_vm_t clone;
+
+    if ((clone = malloc(P4_VM_SIZE(p4vm->maxstk, p4vm->consts))) == NULL)
+        return NULL;
+    memcpy(clone, p4vm, P4_VM_SIZE(p4vm->maxstk, p4vm->consts));
+    image_ref(p4vm->image);
+    clone->jit = NULL;
+
+    return clone;
+} // p4_vm_clone
+
+void p4_vm_free(p4_vm_t p4vm) {
+    image_free(p4vm->image);
+    free(p4vm);
+} // p4_vm_free
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "p4_vm.h"
+
+/* Heap.
+ =====
+ new takes the cells np..maxstk from the top of the variable store downwards,
+ towards the stack. Every block starts with a header cell, vl.ad the number of
+ cells after it and vl.lv its state, and a pointer addresses the first cell
+ after the header. A disposed block goes to the free list of its size, heap[n]
+ for n cells (n < HEAPLISTS) and heap[0] for the larger ones, linked through
+ its first cell; a block disposed at np is given back to the free space at
+ once. new takes a block of its exact size from the lists, else the first large
+ one that fits (splitting off the rest), else cells below np. Only when none
+ of them has room the heap is walked from np up, runs of free blocks are merged
+ into one, the run at np is given back and the lists are built again.
+
+ With p4vm->gc set, new first collects the blocks no longer reachable when it
+ finds no room, and also once it has taken as many cells as were kept by the
+ last collection (at least a sixteenth of the store), so the heap stays near
+ its live size and leaves the stack room. The collector is conservative, it
+ does not know which cells hold pointers: every cell of the stack (0..sp, the
+ globals at its bottom) whose value falls inside an allocated block keeps that
+ block, and the cells of a kept block are looked at the same way. Interior
+ addresses count, a with statement or a var parameter holds the address of a
+ field. The blocks not kept are freed and merged as above. Pointers only held
+ outside the store (the locals of a program translated by p4_aot) are not seen,
+ so such programs must not set gc.
+
+ Headers and free list links are cells of the store, a program writing through
+ a disposed pointer overwrites them. Every block is checked before it is
+ followed or written (block): it lies in np..maxstk with its cells and its
+ header is in the expected state. new and release fail on a broken heap with
+ VMFAULT, dispose of anything else than an allocated block fails as before.
+ */
+
+#define HEAP_USED 1
+#define HEAP_FREE 2 // zeroed cells are no block
+#define HEAP_MARK 4 // used block reached by the collector
+
+// the block at h lies in the heap with its cells and is in state st
+static bool block(p4_vm_t p4vm, int32_t h, int32_t st) {
+    return h >= p4vm->np && h <= p4vm->maxstk && p4vm->store[h].vl.lv == st
+            && (uint32_t) p4vm->store[h].vl.ad <= (uint32_t) (p4vm->maxstk - h);
+} // block
+
+static void push(p4_vm_t p4vm, int32_t h) {
+    int32_t n = p4vm->store[h].vl.ad;
+
+    p4vm->store[h].vl.lv = HEAP_FREE;
+    if (n == 0)
+        return; // header alone, waits for a merge
+    if (n >= HEAPLISTS)
+        n = 0;
+    p4vm->store[h + 1].va = p4vm->heap[n];
+    p4vm->heap[n] = h;
+} // push
+
+// header of a block of n cells, 0 if there is no room, -1 if a list is broken
+static int32_t take(p4_vm_t p4vm, int32_t n) {
+    int32_t h, r, m, *link, k;
+
+    if (n < HEAPLISTS && (h = p4vm->heap[n]) != 0) {
+        if (!block(p4vm, h, HEAP_FREE) || p4vm->store[h].vl.ad != n)
+            return -1;
+        p4vm->heap[n] = p4vm->store[h + 1].va;
+        p4vm->store[h].vl.lv = HEAP_USED;
+        return h;
+    }
+
+    // a list with a loop is broken too, it holds more blocks than the heap
+    k = p4vm->maxstk + 1 - p4vm->np;
+    for (link = &(p4vm->heap[0]); (h = *link) != 0; link = &(p4vm->store[h + 1].va)) {
+        if (k-- == 0 || !block(p4vm, h, HEAP_FREE))
+            return -1;
+        if ((m = p4vm->store[h].vl.ad) < n)
+            continue;
+        *link = p4vm->store[h + 1].va;
+        if (m > n) {
+            r = h + 1 + n;
+            p4vm->store[r].vl.ad = m - n - 1;
+            push(p4vm, r);
+        }
+        p4vm->store[h].vl = (rec_link_t ) { n, HEAP_USED };
+        return h;
+    }
+
+    if (p4vm->np - (n + 1) <= p4vm->ep)
+        return 0;
+    p4vm->np -= n + 1;
+    h = p4vm->np;
+    p4vm->store[h].vl = (rec_link_t ) { n, HEAP_USED };
+    return h;
+} // take
+
+// false if a header is broken
+static bool merge(p4_vm_t p4vm) {
+    int32_t h, e, top = p4vm->maxstk + 1;
+    rec_store_t *store = p4vm->store;
+
+    memset(p4vm->heap, 0, sizeof(p4vm->heap));
+    while (p4vm->np < top && block(p4vm, p4vm->np, HEAP_FREE))
+        p4vm->np += store[p4vm->np].vl.ad + 1;
+
+    for (h = p4vm->np; h < top; h = e) {
+        if (!block(p4vm, h, HEAP_USED) && !block(p4vm, h, HEAP_FREE))
+            return false;
+        e = h + 1 + store[h].vl.ad;
+        if (store[h].vl.lv != HEAP_FREE)
+            continue;
+        while (e < top && block(p4vm, e, HEAP_FREE))
+            e += store[e].vl.ad + 1;
+        store[h].vl.ad = e - h - 1;
+        push(p4vm, h);
+    }
+    return true;
+} // merge
+
+// block of blk[0..n-1] (headers from np up) holding address ad, -1 if none
+static int32_t find(p4_vm_t p4vm, int32_t *blk, int32_t n, int32_t ad) {
+    int32_t lo = 0, hi = n - 1, m;
+
+    if (n == 0 || ad <= blk[0] || ad > p4vm->maxstk)
+        return -1;
+    while (lo < hi) {
+        m = (lo + hi + 1) / 2;
+        if (blk[m] < ad)
+            lo = m;
+        else
+            hi = m - 1;
+    }
+    return (ad <= blk[lo] + p4vm->store[blk[lo]].vl.ad) ? lo : -1;
+} // find
+
+// block found from a cell, pushed on the mark stack if not yet kept
+static void keep(p4_vm_t p4vm, int32_t *blk, int32_t n, int32_t *mark, int32_t *top, int32_t ad) {
+    int32_t b = find(p4vm, blk, n, ad);
+
+    if (b >= 0 && p4vm->store[blk[b]].vl.lv == HEAP_USED) {
+        p4vm->store[blk[b]].vl.lv |= HEAP_MARK;
+        mark[(*top)++] = blk[b];
+    }
+} // keep
+
+// frees the blocks not reached, cells of the blocks kept, -1 if a header is broken
+static int32_t collect(p4_vm_t p4vm) {
+    int32_t h, n = 0, top = 0, ad, live = 0, *blk, *mark, e = p4vm->maxstk + 1;
+    rec_store_t *store = p4vm->store;
+
+    for (h = p4vm->np; h < e; h += store[h].vl.ad + 1) {
+        if (!block(p4vm, h, HEAP_USED) && !block(p4vm, h, HEAP_FREE))
+            return -1;
+        n++;
+    }
+    if (n == 0)
+        return 0;
+    if ((blk = malloc(2 * n * sizeof(int32_t))) == NULL)
+        return e - p4vm->np;
+    mark = blk + n;
+    n = 0;
+    for (h = p4vm->np; h < e; h += store[h].vl.ad + 1)
+        blk[n++] = h;
+
+    // every block is pushed once, so the mark stack holds n
+    for (ad = 0; ad <= p4vm->sp; ad++)
+        keep(p4vm, blk, n, mark, &top, store[ad].va);
+    while (top > 0) {
+        h = mark[--top];
+        for (ad = h + 1; ad <= h + store[h].vl.ad; ad++)
+            keep(p4vm, blk, n, mark, &top, store[ad].va);
+    }
+
+    for (ad = 0; ad < n; ad++) {
+        h = blk[ad];
+        if (store[h].vl.lv == HEAP_USED)
+            store[h].vl.lv = HEAP_FREE;
+        else if (store[h].vl.lv & HEAP_MARK) {
+            store[h].vl.lv = HEAP_USED;
+            live += store[h].vl.ad + 1;
+        }
+    }
+    free(blk);
+
+    return live;
+} // collect
+
+// false if a header is broken
+static bool gc(p4_vm_t p4vm) {
+    int32_t live = collect(p4vm);
+
+    if (live < 0 || !merge(p4vm))
+        return false;
+    p4vm->gcleft = (p4vm->maxstk + 1) / 16;
+    if (live > p4vm->gcleft)
+        p4vm->gcleft = live;
+    return true;
+} // gc
+
+int32_t p4_heap_new(p4_vm_t p4vm, int32_t size) {
+    int32_t h;
+
+    if (size < 1)
+        size = 1; // room for the free list link
+    else if (size > p4vm->maxstk)
+        return 0;
+    if (p4vm->gc && (p4vm->gcleft -= size + 1) < 0 && !gc(p4vm))
+        return -1;
+    if ((h = take(p4vm, size)) == 0) {
+        if (!merge(p4vm))
+            return -1;
+        if ((h = take(p4vm, size)) == 0) {
+            if (!p4vm->gc)
+                return 0;
+            if (!gc(p4vm))
+                return -1;
+            if ((h = take(p4vm, size)) == 0)
+                return 0;
+        }
+    }
+    return (h < 0) ? -1 : h + 1;
+} // p4_heap_new
+
+bool p4_heap_dispose(p4_vm_t p4vm, int32_t ad) {
+    int32_t h = ad - 1;
+
+    if (ad <= p4vm->np || ad > p4vm->maxstk || !block(p4vm, h, HEAP_USED))
+        return false;
+    if (h == p4vm->np)
+        p4vm->np += p4vm->store[h].vl.ad + 1;
+    else
+        push(p4vm, h);
+    return true;
+} // p4_heap_dispose
+
+bool p4_heap_release(p4_vm_t p4vm, int32_t np) {
+    int32_t h, e;
+
+    if (np > p4vm->maxstk + 1)
+        np = p4vm->maxstk + 1;
+    // a merged free block may reach across the mark, it is cut there
+    for (h = p4vm->np; h < np; h = e) {
+        if (!block(p4vm, h, HEAP_USED) && !block(p4vm, h, HEAP_FREE))
+            return false;
+        e = h + 1 + p4vm->store[h].vl.ad;
+        if (e > np) {
+            p4vm->store[np].vl = (rec_link_t ) { e - np - 1, HEAP_FREE };
+            break;
+        }
+    }
+    if (np > p4vm->np)
+        p4vm->np = np;
+    return merge(p4vm);
+} // p4_heap_release
@@ -0,0 +1,819 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "p4_vm.h"
+#include "p4_jit.h"
+
+/* Template JIT.
+ =============
+ A procedure (its code from ent to ret) is translated the first time it is
+ called by copying the template of each P-code operation into the native code
+ area and patching its operands in. The stack stays in the store, so native code
+ and interpreter can hand over at any instruction: an operation without a
+ template (csp, sets ...) writes the registers back and runs through
+ p4_vm_interpret, and xjp, stp and calls or returns to code that has not been
+ compiled do the same and return to p4_jit_exec, which goes on with the native
+ code of the new address or gives it back to p4_vm_run. A call is relinked to
+ the native code of its procedure once that is compiled.
+
+ Traces.
+ =======
+ With the trace tier p4_vm_run counts the backward jumps to each loop head. A
+ head that gets hot has one iteration recorded: it is stepped by p4_vm_interpret
+ while the addresses are logged until control is back at the head. The path is
+ then compiled with the same templates, with the jumps on it left out and each
+ fjp (or comparison and fjp) turned into a guard that leaves the trace where the
+ recorded iteration did not go. A trace ends with a jump to its own start, so it
+ runs until a guard fails. Calls, returns, xjp and inner loops end the recording
+ without a trace.
+ */
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+#include "p4_jit_x64.h"
+
+#define CELL       ((int32_t) sizeof(rec_store_t))
+#define JITINSN    64 // bytes of native code reserved per instruction
+
+typedef struct jit_fix_s {
+    uint8_t *at;   // rel32 to patch
+    uint32_t pc;   // target address, or the failing instruction for HOLE_TRAP and HOLE_FAULT
+     uint8_t kind;
+} jit_fix_t;
+
+typedef struct jit_emit_s {
+     p4_jit_t jit;
+      uint8_t *at;   // next free byte
+     uint32_t pc;    // address being translated
+     uint32_t jump;  // target of HOLE_JUMP
+     uint32_t head;  // loop head of a trace, HOLE_JUMP to it goes to loop
+      uint8_t *loop;
+    jit_fix_t *fix;
+     uint32_t nfix;
+} jit_emit_t;
+
+static void put32(uint8_t *at, int32_t v) {
+    memcpy(at, &v, sizeof(v));
+} // put32
+
+static void putrel(uint8_t *at, uint8_t *target) {
+    put32(at, target - (at + 4));
+} // putrel
+
+// CELL = m << cellshift(), cellinv() * m = 1 modulo 2^32
+static uint8_t cellshift(void) {
+    return __builtin_ctz(CELL);
+} // cellshift
+
+static int32_t cellinv(void) {
+    uint32_t m = CELL >> cellshift(), x = m;
+    int n;
+
+    for (n = 0; n < 5; n++)
+        x *= 2 - m * x;
+    return x;
+} // cellinv
+
+static void emit(jit_emit_t *e, const p4_tpl_t *tpl, int32_t a, int32_t b) {
+    uint64_t addr = (uintptr_t) p4_vm_interpret;
+    uint64_t native = (uintptr_t) e->jit->native;
+    uint8_t *at;
+    int n;
+
+    memcpy(e->at, tpl->code, tpl->len);
+    for (n = 0; n < 12 && tpl->hole[n].kind != 0; n++) {
+        at = e->at + tpl->hole[n].at;
+        switch (tpl->hole[n].kind) {
+            case HOLE_A:
+                put32(at, a);
+                break;
+            case HOLE_B:
+                put32(at, b);
+                break;
+            case HOLE_CELL:
+                put32(at, CELL);
+                break;
+            case HOLE_CELL2:
+                put32(at, 2 * CELL);
+                break;
+            case HOLE_CELL3:
+                put32(at, 3 * CELL);
+                break;
+            case HOLE_CELL4:
+                put32(at, 4 * CELL);
+                break;
+            case HOLE_NCELL:
+                put32(at, -CELL);
+                break;
+            case HOLE_SL:
+                put32(at, CELL + offsetof(rec_link_t, lv));
+                break;
+            case HOLE_DL:
+                put32(at, 2 * CELL + offsetof(rec_link_t, lv));
+                break;
+            case HOLE_SHIFT:
+                *at = cellshift();
+                break;
+            case HOLE_INV:
+                put32(at, cellinv());
+                break;
+            case HOLE_JUMP:
+                e->fix[e->nfix++] = (jit_fix_t ) { at, e->jump, HOLE_JUMP };
+                break;
+            case HOLE_TRAP:
+                e->fix[e->nfix++] = (jit_fix_t ) { at, e->pc, HOLE_TRAP };
+                break;
+            case HOLE_FAULT:
+                e->fix[e->nfix++] = (jit_fix_t ) { at, e->pc, HOLE_FAULT };
+                break;
+            case HOLE_PC:
+                put32(at, offsetof(struct p4_vm_s, pc));
+                break;
+            case HOLE_SP:
+                put32(at, offsetof(struct p4_vm_s, sp));
+                break;
+            case HOLE_MP:
+                put32(at, offsetof(struct p4_vm_s, mp));
+                break;
+            case HOLE_STORE:
+                put32(at, offsetof(struct p4_vm_s, store));
+                break;
+            case HOLE_STUB:
+                putrel(at, e->jit->stub);
+                break;
+            case HOLE_EXIT:
+                putrel(at, e->jit->exit);
+                break;
+            case HOLE_ERR:
+                putrel(at, e->jit->err);
+                break;
+            case HOLE_ADDR:
+                memcpy(at, &addr, sizeof(addr));
+                break;
+            case HOLE_EP:
+                put32(at, offsetof(struct p4_vm_s, ep));
+                break;
+            case HOLE_NP:
+                put32(at, offsetof(struct p4_vm_s, np));
+                break;
+            case HOLE_LV:
+                put32(at, offsetof(struct p4_vm_s, lv));
+                break;
+            case HOLE_DISPLAY:
+                put32(at, offsetof(struct p4_vm_s, display));
+                break;
+            case HOLE_NATIVE:
+                memcpy(at, &native, sizeof(native));
+                break;
+            case HOLE_BACK:
+                putrel(at, e->jit->back);
+                break;
+        }
+    }
+    e->at += tpl->len;
+} // emit
+
+static void fetch(p4_vm_t p4vm, uint32_t pc, uint8_t *op, uint8_t *p, int32_t *q) {
+    rec_code_t *WITH = &(p4vm->code[pc / 2]);
+
+    if (pc & 1) {
+        *op = WITH->op2;
+        *p = WITH->p2;
+        *q = WITH->q2;
+    } else {
+        *op = WITH->op1;
+        *p = WITH->p1;
+        *q = WITH->q1;
+    }
+} // fetch
+
+// display entry of the frame p levels out from a procedure at level lv
+#define DISPLAY(lv, p)    ((int32_t) (offsetof(struct p4_vm_s, display) + sizeof(int32_t) * ((lv) - (p))))
+
+static void translate(jit_emit_t *e, int32_t lv, uint8_t op, uint8_t p, int32_t q) {
+    static const p4_tpl_t *const sset[6] = { &tpl_sete, &tpl_setne, &tpl_setge, &tpl_setg, &tpl_setle, &tpl_setl };
+    static const p4_tpl_t *const uset[6] = { &tpl_sete, &tpl_setne, &tpl_setae, &tpl_seta, &tpl_setbe, &tpl_setb };
+    static const p4_tpl_t *const rset[6] = { &tpl_equr, &tpl_neqr, &tpl_geqr, &tpl_grtr, &tpl_leqr, &tpl_lesr };
+
+    switch (op) {
+        case 0:
+        case 105 ... 109: // lod
+            if (p == 0)
+                emit(e, &tpl_ldl, q * CELL, 0);
+            else
+                emit(e, &tpl_ldd, DISPLAY(lv, p), q * CELL);
+            emit(e, &tpl_push, 0, 0);
+            break;
+
+        case 1:
+        case 65 ... 69: // ldo
+            emit(e, &tpl_ldg, q * CELL, 0);
+            emit(e, &tpl_push, 0, 0);
+            break;
+
+        case 2:
+        case 70 ... 74: // str
+            emit(e, &tpl_pop, 0, 0);
+            if (p == 0)
+                emit(e, &tpl_stl, q * CELL, 0);
+            else
+                emit(e, &tpl_std, DISPLAY(lv, p), q * CELL);
+            break;
+
+        case 3:
+        case 75 ... 79: // sro
+            emit(e, &tpl_pop, 0, 0);
+            emit(e, &tpl_stg, q * CELL, 0);
+            break;
+
+        case 4: // lda
+            if (p == 0)
+                emit(e, &tpl_lal, q, 0);
+            else
+                emit(e, &tpl_lad, DISPLAY(lv, p), q);
+            emit(e, &tpl_push, 0, 0);
+            break;
+
+        case 5:  // lao
+        case 56: // lca
+            emit(e, &tpl_ldi, q, 0);
+            emit(e, &tpl_push, 0, 0);
+            break;
+
+        case 6:
+        case 80 ... 84: // sto
+            emit(e, &tpl_chkrel, -CELL, e->jit->nil);
+            emit(e, &tpl_pop, 0, 0);
+            emit(e, &tpl_sto, 0, 0);
+            break;
+
+        case 7: // ldc
+            emit(e, &tpl_ldi, (p == 1 || p == 6) ? q : (p == 3) ? (q == 1) : e->jit->nil, 0);
+            emit(e, &tpl_push, 0, 0);
+            break;
+
+        case 8: // lci
+            if (p == 4) {
+                emit(e, &tpl_helper, e->pc, 0);
+                break;
+            }
+            emit(e, &tpl_ldg, q * CELL, 0);
+            emit(e, &tpl_push, 0, 0);
+            break;
+
+        case 9:
+        case 85 ... 89: // ind
+            emit(e, &tpl_chkind, q, e->jit->nil);
+            emit(e, &tpl_ind, q * CELL, 0);
+            break;
+
+        case 10:
+        case 90 ... 94: // inc
+            emit(e, &tpl_inc, q, 0);
+            break;
+
+        case 57:
+        case 100 ... 104: // dec
+            emit(e, &tpl_inc, -q, 0);
+            break;
+
+        case 16: // ixa
+            emit(e, &tpl_ixa, q, 0);
+            break;
+
+        case 17 ... 22: // equ, neq, geq, grt, leq, les
+            switch (p) {
+                case 0: // address
+                    if (op > 18) {
+                        emit(e, &tpl_helper, e->pc, 0);
+                        return;
+                    }
+                    emit(e, &tpl_cmpi, 0, 0);
+                    emit(e, sset[op - 17], 0, 0);
+                    break;
+                case 1:
+                    emit(e, &tpl_cmpi, 0, 0);
+                    emit(e, sset[op - 17], 0, 0);
+                    break;
+                case 2:
+                    emit(e, &tpl_cmpr, 0, 0);
+                    emit(e, rset[op - 17], 0, 0);
+                    break;
+                case 3:
+                    emit(e, &tpl_cmpb, 0, 0);
+                    emit(e, uset[op - 17], 0, 0);
+                    break;
+                case 6:
+                    emit(e, &tpl_cmpc, 0, 0);
+                    emit(e, sset[op - 17], 0, 0);
+                    break;
+                default: // sets and strings
+                    emit(e, &tpl_helper, e->pc, 0);
+                    return;
+            }
+            emit(e, &tpl_rel, 0, 0);
+            break;
+
+        case 23: // ujp
+            e->jump = q;
+            emit(e, &tpl_ujp, 0, 0);
+            break;
+
+        case 24: // fjp
+            e->jump = q;
+            emit(e, &tpl_fjp, 0, 0);
+            break;
+
+        case 26:
+        case 96 ... 99: // chk
+            emit(e, &tpl_chk, (q - 1) * CELL, q * CELL);
+            break;
+
+        case 28: // adi
+            emit(e, &tpl_adi, 0, 0);
+            break;
+
+        case 29: // adr
+            emit(e, &tpl_adr, 0, 0);
+            break;
+
+        case 30: // sbi
+            emit(e, &tpl_sbi, 0, 0);
+            break;
+
+        case 31: // sbr
+            emit(e, &tpl_sbr, 0, 0);
+            break;
+
+        case 33: // flt
+            emit(e, &tpl_flt, 0, 0);
+            break;
+
+        case 34: // flo
+            emit(e, &tpl_flo, 0, 0);
+            break;
+
+        case 35: // trc
+            emit(e, &tpl_trc, 0, 0);
+            break;
+
+        case 36: // ngi
+            emit(e, &tpl_ngi, 0, 0);
+            break;
+
+        case 37: // ngr
+            emit(e, &tpl_ngr, 0, 0);
+            break;
+
+        case 38: // sqi
+            emit(e, &tpl_sqi, 0, 0);
+            break;
+
+        case 39: // sqr
+            emit(e, &tpl_sqr, 0, 0);
+            break;
+
+        case 40: // abi
+            emit(e, &tpl_abi, 0, 0);
+            break;
+
+        case 41: // abr
+            emit(e, &tpl_abr, 0, 0);
+            break;
+
+        case 42: // not
+            emit(e, &tpl_not, 0, 0);
+            break;
+
+        case 43: // and
+            emit(e, &tpl_and, 0, 0);
+            break;
+
+        case 44: // ior
+            emit(e, &tpl_ior, 0, 0);
+            break;
+
+        case 49: // mod
+            emit(e, &tpl_mod, 0, 0);
+            break;
+
+        case 50: // odd
+            emit(e, &tpl_odd, 0, 0);
+            break;
+
+        case 51: // mpi
+            emit(e, &tpl_mpi, 0, 0);
+            break;
+
+        case 52: // mpr
+            emit(e, &tpl_mpr, 0, 0);
+            break;
+
+        case 53: // dvi
+            emit(e, &tpl_dvi, 0, 0);
+            break;
+
+        case 54: // dvr
+            emit(e, &tpl_dvr, 0, 0);
+            break;
+
+        case 11: // mst
+            emit(e, &tpl_mst, DISPLAY(lv, p), lv + 1 - p);
+            break;
+
+        case 13: // ent
+            if (p == 1 && (uint32_t) q > (uint32_t) e->jit->maxstk) {
+                emit(e, &tpl_helper, e->pc, 0); // fails
+                break;
+            }
+            emit(e, (p == 1) ? &tpl_ent1 : &tpl_ent2, (p == 1) ? q * CELL : q, 0);
+            break;
+
+        case 59: // ord
+        case 60: // chr
+            break;
+
+        case 12: // cup
+            // p=no of locations for parameters, q=entry point
+            e->jump = q;
+            emit(e, &tpl_chkrel, -(p + 3) * CELL + (int32_t) offsetof(rec_link_t, lv), DISPLAYMAX);
+            emit(e, &tpl_cup, -(p + 4) * CELL, e->pc + 1);
+            break;
+
+        case 14: // ret
+            // continues in the native code of the return address if there is some, once its links are checked
+            emit(e, &tpl_chkmp, 2 * CELL, e->jit->maxstk + 1);
+            emit(e, &tpl_chkmp, 2 * CELL + (int32_t) offsetof(rec_link_t, lv), e->jit->maxstk + 1);
+            emit(e, &tpl_chkmp, 4 * CELL, e->jit->codelen);
+            emit(e, &tpl_chklv, DISPLAYMAX, 0);
+            emit(e, &tpl_ret, (p == 0) ? -CELL : 0, DISPLAY(lv, 0));
+            break;
+
+        case 25: // xjp
+        case 58: // stp
+        case 61: // ujc
+            emit(e, &tpl_leave, e->pc, 0);
+            break;
+
+        default:
+            emit(e, &tpl_helper, e->pc, 0);
+            break;
+    }
+} // translate
+
+static void link(p4_jit_t jit, uint8_t *at, uint32_t pc) {
+    p4_jit_link_t *l;
+
+    if (jit->nlink == jit->maxlink) {
+        l = realloc(jit->link, (2 * jit->maxlink + 16) * sizeof(p4_jit_link_t));
+        if (l == NULL)
+            return; // stays a way out to the interpreter
+        jit->link = l;
+        jit->maxlink = 2 * jit->maxlink + 16;
+    }
+    jit->link[jit->nlink++] = (p4_jit_link_t ) { at, pc };
+} // link
+
+static bool begin(p4_jit_t jit, jit_emit_t *e, uint32_t n) {
+    // room for n instructions, and the checks of a ret
+    if (jit->len + (n + 4) * JITINSN > JITSIZE)
+        return false;
+    e->jit = jit;
+    e->at = jit->buf + jit->len;
+    e->head = PCMAX;
+    e->loop = NULL;
+    e->fix = malloc((2 * n + 4) * sizeof(jit_fix_t));
+    e->nfix = 0;
+    if (e->fix == NULL)
+        return false;
+    mprotect(jit->buf, JITSIZE, PROT_READ | PROT_WRITE);
+
+    return true;
+} // begin
+
+static void finish(p4_vm_t p4vm, jit_emit_t *e) {
+    // failed checks go back to the interpreter, as jumps to code without native code until it has some
+    p4_jit_t jit = e->jit;
+    uint8_t *target = NULL;
+    uint8_t op, p;
+    int32_t q;
+    uint32_t n;
+
+    for (n = 0; n < e->nfix; n++) {
+        if (e->fix[n].kind == HOLE_TRAP || e->fix[n].kind == HOLE_FAULT) {
+            if (n == 0 || e->fix[n - 1].kind != e->fix[n].kind || e->fix[n - 1].pc != e->fix[n].pc) {
+                target = e->at;
+                fetch(p4vm, e->fix[n].pc, &op, &p, &q);
+                emit(e, &tpl_trap, e->fix[n].pc + 1, (e->fix[n].kind == HOLE_FAULT) ? VMFAULT : op);
+            }
+        } else if (e->fix[n].pc == e->head)
+            target = e->loop;
+        else if (jit->native[e->fix[n].pc] != NULL)
+            target = jit->native[e->fix[n].pc];
+        else {
+            target = e->at;
+            emit(e, &tpl_trap, e->fix[n].pc, 255);
+            link(jit, e->fix[n].at, e->fix[n].pc);
+        }
+        putrel(e->fix[n].at, target);
+    }
+
+    jit->len = e->at - jit->buf;
+    mprotect(jit->buf, JITSIZE, PROT_READ | PROT_EXEC);
+    free(e->fix);
+} // finish
+
+static bool compile(p4_vm_t p4vm, uint32_t start) {
+    p4_jit_t jit = p4vm->jit;
+    jit_emit_t e;
+    uint32_t pc, end, n;
+    uint8_t op, p;
+    int32_t q;
+
+    if (jit->tried[start])
+        return false;
+    jit->tried[start] = true;
+
+    // only procedure entries are compiled, up to the ret of the procedure
+    fetch(p4vm, start, &op, &p, &q);
+    if (op != 13)
+        return false;
+    for (end = start; end < p4vm->codelen; end++) {
+        fetch(p4vm, end, &op, &p, &q);
+        if (op == 14)
+            break;
+    }
+    if (end == p4vm->codelen || !begin(jit, &e, end - start + 1))
+        return false;
+
+    // the procedure runs at the level cup has just set
+    for (pc = start; pc <= end; pc++) {
+        jit->native[pc] = e.at;
+        e.pc = pc;
+        fetch(p4vm, pc, &op, &p, &q);
+        translate(&e, p4vm->lv, op, p, q);
+    }
+
+    // jumps already waiting for this procedure
+    for (n = 0; n < jit->nlink;) {
+        if (jit->link[n].pc == start) {
+            putrel(jit->link[n].at, jit->native[start]);
+            jit->link[n] = jit->link[--jit->nlink];
+        } else
+            n++;
+    }
+    finish(p4vm, &e);
+
+    return true;
+} // compile
+
+static void guard(jit_emit_t *e, const p4_tpl_t *tpl, uint32_t exit) {
+    // leave the trace for exit
+    e->jump = exit;
+    emit(e, tpl, 0, 0);
+} // guard
+
+static void comptrace(p4_vm_t p4vm, uint32_t *path, uint32_t n) {
+    static const p4_tpl_t *const sjcc[6] = { &tpl_je, &tpl_jne, &tpl_jge, &tpl_jg, &tpl_jle, &tpl_jl };
+    static const p4_tpl_t *const snjcc[6] = { &tpl_jne, &tpl_je, &tpl_jl, &tpl_jle, &tpl_jg, &tpl_jge };
+    static const p4_tpl_t *const ujcc[6] = { &tpl_je, &tpl_jne, &tpl_jae, &tpl_ja, &tpl_jbe, &tpl_jb };
+    static const p4_tpl_t *const unjcc[6] = { &tpl_jne, &tpl_je, &tpl_jb, &tpl_jbe, &tpl_ja, &tpl_jae };
+    p4_jit_t jit = p4vm->jit;
+    uint32_t k, pc, next, head = path[0];
+    uint8_t op, p, op1, p1;
+    int32_t q, q1;
+    jit_emit_t e;
+
+    if (!begin(jit, &e, n + 1))
+        return;
+    e.head = head;
+    e.loop = e.at;
+
+    for (k = 0; k < n; k++) {
+        pc = path[k];
+        next = (k + 1 < n) ? path[k + 1] : head;
+        e.pc = pc;
+        fetch(p4vm, pc, &op, &p, &q);
+        switch (op) {
+            case 23: // ujp, the trace follows it
+                break;
+
+            case 24: // fjp
+                if (next == pc + 1)
+                    guard(&e, &tpl_fjp, q);
+                else
+                    guard(&e, &tpl_tjp, pc + 1);
+                break;
+
+            case 17 ... 22: // comparison and fjp: compare, drop both operands and guard on the flags
+                if (k + 1 < n) {
+                    fetch(p4vm, next, &op1, &p1, &q1);
+                    if (op1 == 24 && (p == 0 || p == 1 || p == 3 || p == 6)) {
+                        emit(&e, (p == 0 || p == 1) ? &tpl_cmpi : (p == 3) ? &tpl_cmpb : &tpl_cmpc, 0, 0);
+                        emit(&e, &tpl_drop, -2 * CELL, 0);
+                        k++;
+                        next = (k + 1 < n) ? path[k + 1] : head;
+                        if (next == pc + 2)
+                            guard(&e, (p == 3) ? unjcc[op - 17] : snjcc[op - 17], q1);
+                        else
+                            guard(&e, (p == 3) ? ujcc[op - 17] : sjcc[op - 17], pc + 2);
+                        break;
+                    }
+                }
+                translate(&e, p4vm->lv, op, p, q);
+                break;
+
+            default:
+                translate(&e, p4vm->lv, op, p, q);
+                break;
+        }
+    }
+    e.jump = head;
+    emit(&e, &tpl_ujp, 0, 0);
+    finish(p4vm, &e);
+    jit->trace[head] = e.loop;
+} // comptrace
+
+static uint8_t record(p4_vm_t p4vm) {
+    // step one iteration of the loop at p4vm->pc, compile its trace if it gets back to the head
+    uint32_t head = p4vm->pc, pc, n = 0;
+    uint32_t *path;
+    uint8_t op, p, err = 255;
+    int32_t q;
+
+    path = malloc(TRACEMAX * sizeof(uint32_t));
+    if (path == NULL)
+        return 255;
+    do {
+        pc = p4vm->pc;
+        fetch(p4vm, pc, &op, &p, &q);
+        if (n == TRACEMAX || (op >= 11 && op <= 14) || op == 25 || op == 58 || op == 61)
+            break; // mst, cup, ent, ret, xjp, stp, ujc
+        path[n++] = pc;
+        if ((err = p4_vm_interpret(p4vm)) != 255)
+            break;
+        if (p4vm->pc < pc && p4vm->pc != head)
+            break; // inner loop
+    } while (p4vm->pc != head);
+
+    if (err == 255 && p4vm->pc == head && n > 0)
+        comptrace(p4vm, path, n);
+    free(path);
+
+    return err;
+} // record
+
+bool p4_jit_init(p4_vm_t p4vm, uint8_t tier) {
+    p4_jit_t jit;
+    jit_emit_t e;
+
+    p4vm->jit = NULL;
+    if ((uint64_t) MAXSTR(p4vm) * CELL > INT32_MAX) // store offsets are 32-bit displacements
+        return false;
+    jit = calloc(1, sizeof(struct p4_jit_s));
+    if (jit == NULL)
+        return false;
+    p4vm->jit = jit;
+    jit->buf = MAP_FAILED;
+    // one entry per program address (and one past the end), the program is as long as the assembler made it
+    jit->native = calloc(p4vm->codelen + 1, sizeof(uint8_t*));
+    jit->tried = calloc(p4vm->codelen + 1, sizeof(bool));
+    jit->trace = calloc(p4vm->codelen + 1, sizeof(uint8_t*));
+    jit->hot = calloc(p4vm->codelen + 1, sizeof(uint16_t));
+    if (jit->native == NULL || jit->tried == NULL || jit->trace == NULL || jit->hot == NULL
+            || (jit->buf = mmap(NULL, JITSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        p4_jit_free(p4vm);
+        return false;
+    }
+    p4vm->jit = NULL;
+
+    // shared code: entry, exits and the call of p4_vm_interpret
+    jit->tier = tier;
+    jit->nil = MAXSTR(p4vm);
+    jit->maxstk = p4vm->maxstk;
+    jit->codelen = p4vm->codelen;
+    e.jit = jit;
+    e.at = jit->buf;
+    e.fix = NULL;
+    e.nfix = 0;
+    jit->enter = (uint8_t (*)(p4_vm_t, uint8_t*)) e.at;
+    emit(&e, &tpl_enter, 0, 0);
+    jit->exit = e.at;
+    emit(&e, &tpl_exit, 0, 0);
+    jit->err = e.at;
+    emit(&e, &tpl_err, 0, 0);
+    jit->back = e.at;
+    emit(&e, &tpl_back, 0, 0);
+    jit->stub = e.at;
+    emit(&e, &tpl_stub, 0, 0);
+    jit->len = e.at - jit->buf;
+
+    mprotect(jit->buf, JITSIZE, PROT_READ | PROT_EXEC);
+    p4vm->jit = jit;
+
+    return true;
+} // p4_jit_init
+
+void p4_jit_free(p4_vm_t p4vm) {
+    if (p4vm->jit == NULL)
+        return;
+    if (p4vm->jit->buf != MAP_FAILED)
+        munmap(p4vm->jit->buf, JITSIZE);
+    free(p4vm->jit->native);
+    free(p4vm->jit->tried);
+    free(p4vm->jit->trace);
+    free(p4vm->jit->hot);
+    free(p4vm->jit->link);
+    free(p4vm->jit);
+    p4vm->jit = NULL;
+} // p4_jit_free
+
+uint8_t p4_jit_exec(p4_vm_t p4vm) {
+    // run native code from p4vm->pc for as long as there is some
+    p4_jit_t jit = p4vm->jit;
+    uint8_t err;
+
+    while (p4vm->run) {
+        if (jit->native[p4vm->pc] == NULL && !((jit->tier & JIT_METHOD) && compile(p4vm, p4vm->pc)))
+            break;
+        if ((err = jit->enter(p4vm, jit->native[p4vm->pc])) != 255)
+            return err;
+    }
+
+    return 255;
+} // p4_jit_exec
+
+uint8_t p4_jit_loop(p4_vm_t p4vm) {
+    // p4vm->pc is a hot loop head: run its trace, recording it first if there is none
+    p4_jit_t jit = p4vm->jit;
+    uint32_t head = p4vm->pc;
+    uint8_t err;
+
+    if (jit->trace[head] == NULL && (err = record(p4vm)) != 255)
+        return err;
+    if (jit->trace[head] == NULL || p4vm->pc != head)
+        return 255;
+    if ((err = jit->enter(p4vm, jit->trace[head])) != 255)
+        return err;
+
+    return p4_jit_exec(p4vm);
+} // p4_jit_loop
+
+#else
+
+bool p4_jit_init(p4_vm_t p4vm, uint8_t tier) {
+    p4vm->jit = NULL;
+    return false;
+} // p4_jit_init
+
+void p4_jit_free(p4_vm_t p4vm) {
+} // p4_jit_free
+
+uint8_t p4_jit_exec(p4_vm_t p4vm) {
+    return 255;
+} // p4_jit_exec
+
+uint8_t p4_jit_loop(p4_vm_t p4vm) {
+    return 255;
+} // p4_jit_loop
+
+#endif
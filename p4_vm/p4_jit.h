@@ -0,0 +1,81 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef P4_JIT_H_
+#define P4_JIT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "p4_vm.h"
+
+#define JITSIZE    0x400000 // bytes of native code
+#define HOTLOOP    64       // backward jumps to a loop head before its trace is recorded
+#define TRACEMAX   512      // instructions in a trace
+
+// tiers (p4_jit_init)
+#define JIT_METHOD 0x01     // procedures, compiled on their first call
+#define JIT_TRACE  0x02     // hot loops, recorded and compiled as a trace
+
+// jump to an address that had no native code yet
+typedef struct p4_jit_link_s {
+    uint8_t *at; // rel32 of the jump
+    uint32_t pc; // target address
+} p4_jit_link_t;
+
+typedef struct p4_jit_s {
+          uint8_t *buf;           // native code area
+         uint32_t len;            // bytes of buf in use
+          uint8_t *exit;          // way out to the interpreter
+          uint8_t *err;           // way out after a failed helper
+          uint8_t *back;          // way out to a return address without native code
+          uint8_t *stub;          // call of p4_vm_interpret
+          uint8_t tier;           // JIT_* tiers in use
+          int32_t nil;            // value of nil, MAXSTR of the vm
+          int32_t maxstk;         // of the vm, bound of the frames ret returns to
+         uint32_t codelen;        // of the program, bound of the addresses ret returns to
+          uint8_t **native;       // native code of each program address, NULL if interpreted
+             bool *tried;         // address already considered for compilation
+          uint8_t **trace;        // trace of the loop starting at each address
+         uint16_t *hot;           // backward jumps to each address (wraps to retry a failed trace)
+    p4_jit_link_t *link;          // jumps to relink when their target is compiled
+         uint32_t nlink, maxlink;
+          uint8_t (*enter)(p4_vm_t p4vm, uint8_t *at);
+} *p4_jit_t;
+
+   bool p4_jit_init(p4_vm_t p4vm, uint8_t tier);
+   void p4_jit_free(p4_vm_t p4vm);
+uint8_t p4_jit_exec(p4_vm_t p4vm);
+uint8_t p4_jit_loop(p4_vm_t p4vm);
+
+#endif /* P4_JIT_H_ */
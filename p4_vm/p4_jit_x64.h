@@ -0,0 +1,866 @@
+/*
+ * Copyright 2023 Emiliano Gonzalez LU3VEA (lu3vea @ gmail . com))
+ * * Project Site: https://github.com/hiperiondev/pascal_p4_vm *
+ *
+ * This is based on other projects:
+ *      I.J.A.vanGeel@twi.tudelft.nl (August 22 1996) - https://github.com/hiperiondev/pascal_p4_vm/tree/main/original/p4
+ *      - Assembler and interpreter of Pascal code: K. Jensen, N. Wirth, Ch. Jacobi, ETH May 76
+ *
+ *    please contact their authors for more information.
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef P4_JIT_X64_H_
+#define P4_JIT_X64_H_
+
+/* x86-64 templates.
+ =================
+ Machine code for one P-code operation (or a piece of one) with holes for its
+ operands. Each template lists the instructions it was assembled from; the
+ operands were assembled as marker values and the holes record where p4_jit
+ patches the real ones:
+    A, B     instruction operands (addresses are scaled to bytes)
+    CELL     sizeof(rec_store_t) (CELL*n, -CELL and the link fields of a frame too)
+    SHIFT    CELL = m << SHIFT with m odd, INV is the inverse of m modulo 2^32, so
+             a byte offset becomes a cell index with an exact multiplication
+    PC..LV   offset of the p4_vm_s field
+    NATIVE   address of p4_jit_s.native
+    JUMP     rel32 to the native code of a P-code address
+    TRAP     rel32 to the code that reports a failed check
+    FAULT    rel32 to the code that reports an access outside the store (VMFAULT)
+    stub     rel32 to the call of p4_vm_interpret (ADDR), exit/err/back to the way out
+ Registers while running native code:
+    rbx p4vm, rbp &store[sp], r12 mp, r14 &store[0], r15 &store[mp]
+ */
+
+enum {
+    HOLE_A = 1,
+    HOLE_B,
+    HOLE_CELL,
+    HOLE_CELL2,
+    HOLE_CELL3,
+    HOLE_CELL4,
+    HOLE_NCELL,
+    HOLE_SL,
+    HOLE_DL,
+    HOLE_SHIFT,
+    HOLE_INV,
+    HOLE_JUMP,
+    HOLE_TRAP,
+    HOLE_PC,
+    HOLE_SP,
+    HOLE_MP,
+    HOLE_STORE,
+    HOLE_STUB,
+    HOLE_EXIT,
+    HOLE_ERR,
+    HOLE_ADDR,
+    HOLE_EP,
+    HOLE_NP,
+    HOLE_LV,
+    HOLE_DISPLAY,
+    HOLE_NATIVE,
+    HOLE_BACK,
+    HOLE_FAULT,
+};
+
+typedef struct p4_hole_s {
+    uint8_t at;
+    uint8_t kind;
+} p4_hole_t;
+
+typedef struct p4_tpl_s {
+          uint8_t len;
+        p4_hole_t hole[12];
+    const uint8_t *code;
+} p4_tpl_t;
+
+// push rbx; push rbp; push r12; push r14; push r15; mov rbx,rdi; lea r14,[rdi+STORE]; movsxd rax,dword ptr [rbx+SP]; imul rax,rax,CELL; lea rbp,[r14+rax]; movsxd r12,dword ptr [rbx+MP]; imul rax,r12,CELL; lea r15,[r14+rax]; jmp rsi
+static const p4_tpl_t tpl_enter = {
+    56, { { 14, HOLE_STORE }, { 21, HOLE_SP }, { 28, HOLE_CELL }, { 39, HOLE_MP }, { 46, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x53, 0x55, 0x41, 0x54, 0x41, 0x56, 0x41, 0x57, 0x48, 0x89, 0xfb, 0x4c, 0x8d, 0xb7, 0x00, 0x00,
+        0x00, 0x00, 0x48, 0x63, 0x83, 0x00, 0x00, 0x00, 0x00, 0x48, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00,
+        0x49, 0x8d, 0x2c, 0x06, 0x4c, 0x63, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x49, 0x69, 0xc4, 0x00, 0x00,
+        0x00, 0x00, 0x4d, 0x8d, 0x3c, 0x06, 0xff, 0xe6,
+    }
+};
+
+// mov dword ptr [rbx+PC],eax; mov r8d,edx; mov rax,rbp; sub rax,r14; sar rax,SHIFT; imul eax,eax,INV; mov dword ptr [rbx+SP],eax; mov dword ptr [rbx+MP],r12d; mov eax,r8d; pop r15; pop r14; pop r12; pop rbp; pop rbx; ret
+static const p4_tpl_t tpl_exit = {
+    50, { { 2, HOLE_PC }, { 18, HOLE_SHIFT }, { 21, HOLE_INV }, { 27, HOLE_SP }, { 34, HOLE_MP } },
+    (const uint8_t[]) {
+        0x89, 0x83, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xd0, 0x48, 0x89, 0xe8, 0x4c, 0x29, 0xf0, 0x48,
+        0xc1, 0xf8, 0x00, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x89, 0x83, 0x00, 0x00, 0x00, 0x00, 0x44,
+        0x89, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x44, 0x89, 0xc0, 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5c, 0x5d,
+        0x5b, 0xc3,
+    }
+};
+
+// movzx edx,al; mov eax,dword ptr [rbx+PC]; jmp exit
+static const p4_tpl_t tpl_err = {
+    14, { { 5, HOLE_PC }, { 10, HOLE_EXIT } },
+    (const uint8_t[]) {
+        0x0f, 0xb6, 0xd0, 0x8b, 0x83, 0x00, 0x00, 0x00, 0x00, 0xe9, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// sub rsp,0x8; mov rax,rbp; sub rax,r14; sar rax,SHIFT; imul eax,eax,INV; mov dword ptr [rbx+SP],eax; mov dword ptr [rbx+MP],r12d; mov rdi,rbx; movabs rax,ADDR; call rax; movzx edx,al; movsxd rax,dword ptr [rbx+SP]; imul rax,rax,CELL; lea rbp,[r14+rax]; movsxd r12,dword ptr [rbx+MP]; imul rax,r12,CELL; lea r15,[r14+rax]; mov eax,edx; add rsp,0x8; ret
+static const p4_tpl_t tpl_stub = {
+    94, { { 13, HOLE_SHIFT }, { 16, HOLE_INV }, { 22, HOLE_SP }, { 29, HOLE_MP }, { 38, HOLE_ADDR }, { 54, HOLE_SP }, { 61, HOLE_CELL }, { 72, HOLE_MP }, { 79, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x48, 0x83, 0xec, 0x08, 0x48, 0x89, 0xe8, 0x4c, 0x29, 0xf0, 0x48, 0xc1, 0xf8, 0x00, 0x69, 0xc0,
+        0x00, 0x00, 0x00, 0x00, 0x89, 0x83, 0x00, 0x00, 0x00, 0x00, 0x44, 0x89, 0xa3, 0x00, 0x00, 0x00,
+        0x00, 0x48, 0x89, 0xdf, 0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xd0,
+        0x0f, 0xb6, 0xd0, 0x48, 0x63, 0x83, 0x00, 0x00, 0x00, 0x00, 0x48, 0x69, 0xc0, 0x00, 0x00, 0x00,
+        0x00, 0x49, 0x8d, 0x2c, 0x06, 0x4c, 0x63, 0xa3, 0x00, 0x00, 0x00, 0x00, 0x49, 0x69, 0xc4, 0x00,
+        0x00, 0x00, 0x00, 0x4d, 0x8d, 0x3c, 0x06, 0x89, 0xd0, 0x48, 0x83, 0xc4, 0x08, 0xc3,
+    }
+};
+
+// mov dword ptr [rbx+PC],A; call stub; cmp al,0xff; jne err
+static const p4_tpl_t tpl_helper = {
+    23, { { 2, HOLE_PC }, { 6, HOLE_A }, { 11, HOLE_STUB }, { 19, HOLE_ERR } },
+    (const uint8_t[]) {
+        0xc7, 0x83, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe8, 0x00, 0x00, 0x00, 0x00, 0x3c,
+        0xff, 0x0f, 0x85, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov dword ptr [rbx+PC],A; call stub; movzx edx,al; mov eax,dword ptr [rbx+PC]; jmp exit
+static const p4_tpl_t tpl_leave = {
+    29, { { 2, HOLE_PC }, { 6, HOLE_A }, { 11, HOLE_STUB }, { 20, HOLE_PC }, { 25, HOLE_EXIT } },
+    (const uint8_t[]) {
+        0xc7, 0x83, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe8, 0x00, 0x00, 0x00, 0x00, 0x0f,
+        0xb6, 0xd0, 0x8b, 0x83, 0x00, 0x00, 0x00, 0x00, 0xe9, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov eax,A; mov edx,B; jmp exit
+static const p4_tpl_t tpl_trap = {
+    15, { { 1, HOLE_A }, { 6, HOLE_B }, { 11, HOLE_EXIT } },
+    (const uint8_t[]) {
+        0xb8, 0x00, 0x00, 0x00, 0x00, 0xba, 0x00, 0x00, 0x00, 0x00, 0xe9, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov rcx,qword ptr [r15+A]
+static const p4_tpl_t tpl_ldl = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x49, 0x8b, 0x8f, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// movsxd rax,dword ptr [rbx+A]; imul rax,rax,CELL; mov rcx,qword ptr [r14+rax*1+B]
+static const p4_tpl_t tpl_ldd = {
+    22, { { 3, HOLE_A }, { 10, HOLE_CELL }, { 18, HOLE_B } },
+    (const uint8_t[]) {
+        0x48, 0x63, 0x83, 0x00, 0x00, 0x00, 0x00, 0x48, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x49, 0x8b,
+        0x8c, 0x06, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov rcx,qword ptr [r14+A]
+static const p4_tpl_t tpl_ldg = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x49, 0x8b, 0x8e, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov rcx,A
+static const p4_tpl_t tpl_ldi = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x48, 0xc7, 0xc1, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// lea rcx,[r12+A]
+static const p4_tpl_t tpl_lal = {
+    8, { { 4, HOLE_A } },
+    (const uint8_t[]) {
+        0x49, 0x8d, 0x8c, 0x24, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// movsxd rcx,dword ptr [rbx+A]; add rcx,B
+static const p4_tpl_t tpl_lad = {
+    14, { { 3, HOLE_A }, { 10, HOLE_B } },
+    (const uint8_t[]) {
+        0x48, 0x63, 0x8b, 0x00, 0x00, 0x00, 0x00, 0x48, 0x81, 0xc1, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// add rbp,CELL; mov qword ptr [rbp],rcx
+static const p4_tpl_t tpl_push = {
+    11, { { 3, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x48, 0x81, 0xc5, 0x00, 0x00, 0x00, 0x00, 0x48, 0x89, 0x4d, 0x00,
+    }
+};
+
+// mov rcx,qword ptr [rbp]; sub rbp,CELL
+static const p4_tpl_t tpl_pop = {
+    11, { { 7, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x48, 0x8b, 0x4d, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov qword ptr [r15+A],rcx
+static const p4_tpl_t tpl_stl = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x49, 0x89, 0x8f, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// movsxd rax,dword ptr [rbx+A]; imul rax,rax,CELL; mov qword ptr [r14+rax*1+B],rcx
+static const p4_tpl_t tpl_std = {
+    22, { { 3, HOLE_A }, { 10, HOLE_CELL }, { 18, HOLE_B } },
+    (const uint8_t[]) {
+        0x48, 0x63, 0x83, 0x00, 0x00, 0x00, 0x00, 0x48, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x49, 0x89,
+        0x8c, 0x06, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov qword ptr [r14+A],rcx
+static const p4_tpl_t tpl_stg = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x49, 0x89, 0x8e, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// movsxd rax,dword ptr [rbp]; sub rbp,CELL; imul rax,rax,CELL; mov qword ptr [r14+rax],rcx
+static const p4_tpl_t tpl_sto = {
+    22, { { 7, HOLE_CELL }, { 14, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x48, 0x63, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x48, 0x69, 0xc0, 0x00, 0x00,
+        0x00, 0x00, 0x49, 0x89, 0x0c, 0x06,
+    }
+};
+
+// movsxd rax,dword ptr [rbp]; imul rax,rax,CELL; mov rcx,qword ptr [r14+rax*1+A]; mov qword ptr [rbp],rcx
+static const p4_tpl_t tpl_ind = {
+    23, { { 7, HOLE_CELL }, { 15, HOLE_A } },
+    (const uint8_t[]) {
+        0x48, 0x63, 0x45, 0x00, 0x48, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x49, 0x8b, 0x8c, 0x06, 0x00,
+        0x00, 0x00, 0x00, 0x48, 0x89, 0x4d, 0x00,
+    }
+};
+
+// add dword ptr [rbp],A
+static const p4_tpl_t tpl_inc = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x81, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp]; imul eax,eax,A; sub rbp,CELL; add dword ptr [rbp],eax
+static const p4_tpl_t tpl_ixa = {
+    19, { { 5, HOLE_A }, { 12, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00,
+        0x01, 0x45, 0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp]; sub rbp,CELL; add dword ptr [rbp],eax
+static const p4_tpl_t tpl_adi = {
+    13, { { 6, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x01, 0x45, 0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp]; sub rbp,CELL; sub dword ptr [rbp],eax
+static const p4_tpl_t tpl_sbi = {
+    13, { { 6, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x29, 0x45, 0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp]; sub rbp,CELL; imul eax,dword ptr [rbp]; mov dword ptr [rbp],eax
+static const p4_tpl_t tpl_mpi = {
+    17, { { 6, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xaf, 0x45, 0x00, 0x89, 0x45,
+        0x00,
+    }
+};
+
+// mov ecx,dword ptr [rbp]; sub rbp,CELL; mov eax,dword ptr [rbp]; cdq; idiv ecx; mov dword ptr [rbp],eax
+static const p4_tpl_t tpl_dvi = {
+    19, { { 6, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8b, 0x4d, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x8b, 0x45, 0x00, 0x99, 0xf7, 0xf9,
+        0x89, 0x45, 0x00,
+    }
+};
+
+// mov ecx,dword ptr [rbp]; sub rbp,CELL; mov eax,dword ptr [rbp]; cdq; idiv ecx; mov dword ptr [rbp],edx
+static const p4_tpl_t tpl_mod = {
+    19, { { 6, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8b, 0x4d, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x8b, 0x45, 0x00, 0x99, 0xf7, 0xf9,
+        0x89, 0x55, 0x00,
+    }
+};
+
+// movsd xmm0,qword ptr [rbp-CELL]; addsd xmm0,qword ptr [rbp]; sub rbp,CELL; movsd qword ptr [rbp],xmm0
+static const p4_tpl_t tpl_adr = {
+    25, { { 4, HOLE_NCELL }, { 16, HOLE_CELL } },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x10, 0x85, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x58, 0x45, 0x00, 0x48, 0x81, 0xed,
+        0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x11, 0x45, 0x00,
+    }
+};
+
+// movsd xmm0,qword ptr [rbp-CELL]; subsd xmm0,qword ptr [rbp]; sub rbp,CELL; movsd qword ptr [rbp],xmm0
+static const p4_tpl_t tpl_sbr = {
+    25, { { 4, HOLE_NCELL }, { 16, HOLE_CELL } },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x10, 0x85, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x5c, 0x45, 0x00, 0x48, 0x81, 0xed,
+        0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x11, 0x45, 0x00,
+    }
+};
+
+// movsd xmm0,qword ptr [rbp-CELL]; mulsd xmm0,qword ptr [rbp]; sub rbp,CELL; movsd qword ptr [rbp],xmm0
+static const p4_tpl_t tpl_mpr = {
+    25, { { 4, HOLE_NCELL }, { 16, HOLE_CELL } },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x10, 0x85, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x59, 0x45, 0x00, 0x48, 0x81, 0xed,
+        0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x11, 0x45, 0x00,
+    }
+};
+
+// movsd xmm0,qword ptr [rbp-CELL]; divsd xmm0,qword ptr [rbp]; sub rbp,CELL; movsd qword ptr [rbp],xmm0
+static const p4_tpl_t tpl_dvr = {
+    25, { { 4, HOLE_NCELL }, { 16, HOLE_CELL } },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x10, 0x85, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x5e, 0x45, 0x00, 0x48, 0x81, 0xed,
+        0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x11, 0x45, 0x00,
+    }
+};
+
+// cvtsi2sd xmm0,dword ptr [rbp]; movsd qword ptr [rbp],xmm0
+static const p4_tpl_t tpl_flt = {
+    10, {  },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x2a, 0x45, 0x00, 0xf2, 0x0f, 0x11, 0x45, 0x00,
+    }
+};
+
+// cvtsi2sd xmm0,dword ptr [rbp-CELL]; movsd qword ptr [rbp-CELL],xmm0
+static const p4_tpl_t tpl_flo = {
+    16, { { 4, HOLE_NCELL }, { 12, HOLE_NCELL } },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x2a, 0x85, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x11, 0x85, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// cvttsd2si rax,qword ptr [rbp]; mov dword ptr [rbp],eax
+static const p4_tpl_t tpl_trc = {
+    9, {  },
+    (const uint8_t[]) {
+        0xf2, 0x48, 0x0f, 0x2c, 0x45, 0x00, 0x89, 0x45, 0x00,
+    }
+};
+
+// neg dword ptr [rbp]
+static const p4_tpl_t tpl_ngi = {
+    3, {  },
+    (const uint8_t[]) {
+        0xf7, 0x5d, 0x00,
+    }
+};
+
+// btc qword ptr [rbp],0x3f
+static const p4_tpl_t tpl_ngr = {
+    6, {  },
+    (const uint8_t[]) {
+        0x48, 0x0f, 0xba, 0x7d, 0x00, 0x3f,
+    }
+};
+
+// mov eax,dword ptr [rbp]; imul eax,eax; mov dword ptr [rbp],eax
+static const p4_tpl_t tpl_sqi = {
+    9, {  },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x0f, 0xaf, 0xc0, 0x89, 0x45, 0x00,
+    }
+};
+
+// movsd xmm0,qword ptr [rbp]; mulsd xmm0,xmm0; movsd qword ptr [rbp],xmm0
+static const p4_tpl_t tpl_sqr = {
+    14, {  },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x10, 0x45, 0x00, 0xf2, 0x0f, 0x59, 0xc0, 0xf2, 0x0f, 0x11, 0x45, 0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp]; cdq; xor eax,edx; sub eax,edx; mov dword ptr [rbp],eax
+static const p4_tpl_t tpl_abi = {
+    11, {  },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x99, 0x31, 0xd0, 0x29, 0xd0, 0x89, 0x45, 0x00,
+    }
+};
+
+// btr qword ptr [rbp],0x3f
+static const p4_tpl_t tpl_abr = {
+    6, {  },
+    (const uint8_t[]) {
+        0x48, 0x0f, 0xba, 0x75, 0x00, 0x3f,
+    }
+};
+
+// xor byte ptr [rbp],0x1
+static const p4_tpl_t tpl_not = {
+    4, {  },
+    (const uint8_t[]) {
+        0x80, 0x75, 0x00, 0x01,
+    }
+};
+
+// mov al,byte ptr [rbp]; sub rbp,CELL; and byte ptr [rbp],al
+static const p4_tpl_t tpl_and = {
+    13, { { 6, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8a, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x20, 0x45, 0x00,
+    }
+};
+
+// mov al,byte ptr [rbp]; sub rbp,CELL; or byte ptr [rbp],al
+static const p4_tpl_t tpl_ior = {
+    13, { { 6, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8a, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x08, 0x45, 0x00,
+    }
+};
+
+// and dword ptr [rbp],0x1
+static const p4_tpl_t tpl_odd = {
+    4, {  },
+    (const uint8_t[]) {
+        0x83, 0x65, 0x00, 0x01,
+    }
+};
+
+// jmp JUMP
+static const p4_tpl_t tpl_ujp = {
+    5, { { 1, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0xe9, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov al,byte ptr [rbp]; sub rbp,CELL; test al,al; je JUMP
+static const p4_tpl_t tpl_fjp = {
+    18, { { 6, HOLE_CELL }, { 14, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x8a, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x84, 0xc0, 0x0f, 0x84, 0x00, 0x00,
+        0x00, 0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp]; cmp eax,dword ptr [r14+A]; jl TRAP; cmp eax,dword ptr [r14+B]; jg TRAP
+static const p4_tpl_t tpl_chk = {
+    29, { { 6, HOLE_A }, { 12, HOLE_TRAP }, { 19, HOLE_B }, { 25, HOLE_TRAP } },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x41, 0x3b, 0x86, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x8c, 0x00, 0x00, 0x00, 0x00,
+        0x41, 0x3b, 0x86, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x8f, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp+A]; cmp eax,B; jae FAULT
+static const p4_tpl_t tpl_chkrel = {
+    17, { { 2, HOLE_A }, { 7, HOLE_B }, { 13, HOLE_FAULT } },
+    (const uint8_t[]) {
+        0x8b, 0x85, 0x00, 0x00, 0x00, 0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x83, 0x00, 0x00, 0x00,
+        0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp]; add eax,A; cmp eax,B; jae FAULT
+static const p4_tpl_t tpl_chkind = {
+    19, { { 4, HOLE_A }, { 9, HOLE_B }, { 15, HOLE_FAULT } },
+    (const uint8_t[]) {
+        0x8b, 0x45, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x83, 0x00,
+        0x00, 0x00, 0x00,
+    }
+};
+
+// mov eax,dword ptr [r15+A]; cmp eax,B; jae FAULT
+static const p4_tpl_t tpl_chkmp = {
+    18, { { 3, HOLE_A }, { 8, HOLE_B }, { 14, HOLE_FAULT } },
+    (const uint8_t[]) {
+        0x41, 0x8b, 0x87, 0x00, 0x00, 0x00, 0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x83, 0x00, 0x00,
+        0x00, 0x00,
+    }
+};
+
+// mov eax,dword ptr [r15+CELL*2]; imul rax,rax,CELL; mov eax,dword ptr [r14+rax*1+SL]; cmp eax,A; jae FAULT
+static const p4_tpl_t tpl_chklv = {
+    33, { { 3, HOLE_CELL2 }, { 10, HOLE_CELL }, { 18, HOLE_SL }, { 23, HOLE_A }, { 29, HOLE_FAULT } },
+    (const uint8_t[]) {
+        0x41, 0x8b, 0x87, 0x00, 0x00, 0x00, 0x00, 0x48, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x41, 0x8b,
+        0x84, 0x06, 0x00, 0x00, 0x00, 0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x83, 0x00, 0x00, 0x00,
+        0x00,
+    }
+};
+
+// mov eax,dword ptr [rbp-CELL]; cmp eax,dword ptr [rbp]
+static const p4_tpl_t tpl_cmpi = {
+    9, { { 2, HOLE_NCELL } },
+    (const uint8_t[]) {
+        0x8b, 0x85, 0x00, 0x00, 0x00, 0x00, 0x3b, 0x45, 0x00,
+    }
+};
+
+// movsx eax,word ptr [rbp-CELL]; movsx ecx,word ptr [rbp]; cmp eax,ecx
+static const p4_tpl_t tpl_cmpc = {
+    13, { { 3, HOLE_NCELL } },
+    (const uint8_t[]) {
+        0x0f, 0xbf, 0x85, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xbf, 0x4d, 0x00, 0x39, 0xc8,
+    }
+};
+
+// mov al,byte ptr [rbp-CELL]; cmp al,byte ptr [rbp]
+static const p4_tpl_t tpl_cmpb = {
+    9, { { 2, HOLE_NCELL } },
+    (const uint8_t[]) {
+        0x8a, 0x85, 0x00, 0x00, 0x00, 0x00, 0x3a, 0x45, 0x00,
+    }
+};
+
+// movsd xmm0,qword ptr [rbp-CELL]; movsd xmm1,qword ptr [rbp]
+static const p4_tpl_t tpl_cmpr = {
+    13, { { 4, HOLE_NCELL } },
+    (const uint8_t[]) {
+        0xf2, 0x0f, 0x10, 0x85, 0x00, 0x00, 0x00, 0x00, 0xf2, 0x0f, 0x10, 0x4d, 0x00,
+    }
+};
+
+// sete al
+static const p4_tpl_t tpl_sete = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x94, 0xc0,
+    }
+};
+
+// setne al
+static const p4_tpl_t tpl_setne = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x95, 0xc0,
+    }
+};
+
+// setge al
+static const p4_tpl_t tpl_setge = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x9d, 0xc0,
+    }
+};
+
+// setg al
+static const p4_tpl_t tpl_setg = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x9f, 0xc0,
+    }
+};
+
+// setle al
+static const p4_tpl_t tpl_setle = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x9e, 0xc0,
+    }
+};
+
+// setl al
+static const p4_tpl_t tpl_setl = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x9c, 0xc0,
+    }
+};
+
+// setae al
+static const p4_tpl_t tpl_setae = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x93, 0xc0,
+    }
+};
+
+// seta al
+static const p4_tpl_t tpl_seta = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x97, 0xc0,
+    }
+};
+
+// setbe al
+static const p4_tpl_t tpl_setbe = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x96, 0xc0,
+    }
+};
+
+// setb al
+static const p4_tpl_t tpl_setb = {
+    3, {  },
+    (const uint8_t[]) {
+        0x0f, 0x92, 0xc0,
+    }
+};
+
+// ucomisd xmm0,xmm1; sete al; setnp cl; and al,cl
+static const p4_tpl_t tpl_equr = {
+    12, {  },
+    (const uint8_t[]) {
+        0x66, 0x0f, 0x2e, 0xc1, 0x0f, 0x94, 0xc0, 0x0f, 0x9b, 0xc1, 0x20, 0xc8,
+    }
+};
+
+// ucomisd xmm0,xmm1; setne al; setp cl; or al,cl
+static const p4_tpl_t tpl_neqr = {
+    12, {  },
+    (const uint8_t[]) {
+        0x66, 0x0f, 0x2e, 0xc1, 0x0f, 0x95, 0xc0, 0x0f, 0x9a, 0xc1, 0x08, 0xc8,
+    }
+};
+
+// ucomisd xmm0,xmm1; setae al
+static const p4_tpl_t tpl_geqr = {
+    7, {  },
+    (const uint8_t[]) {
+        0x66, 0x0f, 0x2e, 0xc1, 0x0f, 0x93, 0xc0,
+    }
+};
+
+// ucomisd xmm0,xmm1; seta al
+static const p4_tpl_t tpl_grtr = {
+    7, {  },
+    (const uint8_t[]) {
+        0x66, 0x0f, 0x2e, 0xc1, 0x0f, 0x97, 0xc0,
+    }
+};
+
+// ucomisd xmm1,xmm0; setae al
+static const p4_tpl_t tpl_leqr = {
+    7, {  },
+    (const uint8_t[]) {
+        0x66, 0x0f, 0x2e, 0xc8, 0x0f, 0x93, 0xc0,
+    }
+};
+
+// ucomisd xmm1,xmm0; seta al
+static const p4_tpl_t tpl_lesr = {
+    7, {  },
+    (const uint8_t[]) {
+        0x66, 0x0f, 0x2e, 0xc8, 0x0f, 0x97, 0xc0,
+    }
+};
+
+// mov eax,dword ptr [rbx+A]; add rbp,CELL; add rbp,CELL; mov dword ptr [rbp],eax; mov dword ptr [rbp+0x4],B; add rbp,CELL; mov dword ptr [rbp],r12d; add rbp,CELL; mov eax,dword ptr [rbx+EP]; mov dword ptr [rbp],eax; add rbp,CELL
+static const p4_tpl_t tpl_mst = {
+    64, { { 2, HOLE_A }, { 9, HOLE_CELL }, { 16, HOLE_CELL }, { 26, HOLE_B }, { 33, HOLE_CELL }, { 44, HOLE_CELL }, { 50, HOLE_EP }, { 60, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x8b, 0x83, 0x00, 0x00, 0x00, 0x00, 0x48, 0x81, 0xc5, 0x00, 0x00, 0x00, 0x00, 0x48, 0x81, 0xc5,
+        0x00, 0x00, 0x00, 0x00, 0x89, 0x45, 0x00, 0xc7, 0x45, 0x04, 0x00, 0x00, 0x00, 0x00, 0x48, 0x81,
+        0xc5, 0x00, 0x00, 0x00, 0x00, 0x44, 0x89, 0x65, 0x00, 0x48, 0x81, 0xc5, 0x00, 0x00, 0x00, 0x00,
+        0x8b, 0x83, 0x00, 0x00, 0x00, 0x00, 0x89, 0x45, 0x00, 0x48, 0x81, 0xc5, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// lea rbp,[r15+A]
+static const p4_tpl_t tpl_ent1 = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x49, 0x8d, 0xaf, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov rax,rbp; sub rax,r14; sar rax,SHIFT; imul eax,eax,INV; add eax,A; mov dword ptr [rbx+EP],eax; cmp eax,dword ptr [rbx+NP]; jg TRAP
+static const p4_tpl_t tpl_ent2 = {
+    39, { { 9, HOLE_SHIFT }, { 12, HOLE_INV }, { 17, HOLE_A }, { 23, HOLE_EP }, { 29, HOLE_NP }, { 35, HOLE_TRAP } },
+    (const uint8_t[]) {
+        0x48, 0x89, 0xe8, 0x4c, 0x29, 0xf0, 0x48, 0xc1, 0xf8, 0x00, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00,
+        0x05, 0x00, 0x00, 0x00, 0x00, 0x89, 0x83, 0x00, 0x00, 0x00, 0x00, 0x3b, 0x83, 0x00, 0x00, 0x00,
+        0x00, 0x0f, 0x8f, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// mov edx,0xff; jmp exit
+static const p4_tpl_t tpl_back = {
+    10, { { 6, HOLE_EXIT } },
+    (const uint8_t[]) {
+        0xba, 0xff, 0x00, 0x00, 0x00, 0xe9, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// lea r15,[rbp+A]; mov rax,r15; sub rax,r14; sar rax,SHIFT; imul eax,eax,INV; movsxd r12,eax; mov dword ptr [r15+CELL*4],B; movsxd rax,dword ptr [r15+CELL+4]; mov word ptr [rbx+LV],ax; mov ecx,dword ptr [rbx+rax*4+DISPLAY]; mov dword ptr [r15+CELL*2+4],ecx; mov dword ptr [rbx+rax*4+DISPLAY],r12d; jmp JUMP
+static const p4_tpl_t tpl_cup = {
+    78, { { 3, HOLE_A }, { 16, HOLE_SHIFT }, { 19, HOLE_INV }, { 29, HOLE_CELL4 }, { 33, HOLE_B }, { 40, HOLE_SL }, { 47, HOLE_LV }, { 54, HOLE_DISPLAY }, { 61, HOLE_DL }, { 69, HOLE_DISPLAY }, { 74, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x4c, 0x8d, 0xbd, 0x00, 0x00, 0x00, 0x00, 0x4c, 0x89, 0xf8, 0x4c, 0x29, 0xf0, 0x48, 0xc1, 0xf8,
+        0x00, 0x69, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x4c, 0x63, 0xe0, 0x41, 0xc7, 0x87, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x49, 0x63, 0x87, 0x00, 0x00, 0x00, 0x00, 0x66, 0x89, 0x83, 0x00,
+        0x00, 0x00, 0x00, 0x8b, 0x8c, 0x83, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0x8f, 0x00, 0x00, 0x00,
+        0x00, 0x44, 0x89, 0xa4, 0x83, 0x00, 0x00, 0x00, 0x00, 0xe9, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// lea rbp,[r15+A]; mov ecx,dword ptr [r15+CELL*3]; mov dword ptr [rbx+EP],ecx; mov ecx,dword ptr [r15+CELL*2+4]; mov dword ptr [rbx+B],ecx; mov eax,dword ptr [r15+CELL*4]; movsxd r12,dword ptr [r15+CELL*2]; imul r15,r12,CELL; add r15,r14; mov ecx,dword ptr [r15+CELL+4]; mov word ptr [rbx+LV],cx; movabs rcx,NATIVE; mov rcx,qword ptr [rcx+rax*8]; test rcx,rcx; je back; jmp rcx
+static const p4_tpl_t tpl_ret = {
+    96, { { 3, HOLE_A }, { 10, HOLE_CELL3 }, { 16, HOLE_EP }, { 23, HOLE_DL }, { 29, HOLE_B }, { 36, HOLE_CELL4 }, { 43, HOLE_CELL2 }, { 50, HOLE_CELL }, { 60, HOLE_SL }, { 67, HOLE_LV }, { 73, HOLE_NATIVE }, { 90, HOLE_BACK } },
+    (const uint8_t[]) {
+        0x49, 0x8d, 0xaf, 0x00, 0x00, 0x00, 0x00, 0x41, 0x8b, 0x8f, 0x00, 0x00, 0x00, 0x00, 0x89, 0x8b,
+        0x00, 0x00, 0x00, 0x00, 0x41, 0x8b, 0x8f, 0x00, 0x00, 0x00, 0x00, 0x89, 0x8b, 0x00, 0x00, 0x00,
+        0x00, 0x41, 0x8b, 0x87, 0x00, 0x00, 0x00, 0x00, 0x4d, 0x63, 0xa7, 0x00, 0x00, 0x00, 0x00, 0x4d,
+        0x69, 0xfc, 0x00, 0x00, 0x00, 0x00, 0x4d, 0x01, 0xf7, 0x41, 0x8b, 0x8f, 0x00, 0x00, 0x00, 0x00,
+        0x66, 0x89, 0x8b, 0x00, 0x00, 0x00, 0x00, 0x48, 0xb9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x48, 0x8b, 0x0c, 0xc1, 0x48, 0x85, 0xc9, 0x0f, 0x84, 0x00, 0x00, 0x00, 0x00, 0xff, 0xe1,
+    }
+};
+
+// mov al,byte ptr [rbp]; sub rbp,CELL; test al,al; jne JUMP
+static const p4_tpl_t tpl_tjp = {
+    18, { { 6, HOLE_CELL }, { 14, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x8a, 0x45, 0x00, 0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x84, 0xc0, 0x0f, 0x85, 0x00, 0x00,
+        0x00, 0x00,
+    }
+};
+
+// lea rbp,[rbp+A]
+static const p4_tpl_t tpl_drop = {
+    7, { { 3, HOLE_A } },
+    (const uint8_t[]) {
+        0x48, 0x8d, 0xad, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// je JUMP
+static const p4_tpl_t tpl_je = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x84, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jne JUMP
+static const p4_tpl_t tpl_jne = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x85, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jge JUMP
+static const p4_tpl_t tpl_jge = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x8d, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jg JUMP
+static const p4_tpl_t tpl_jg = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x8f, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jle JUMP
+static const p4_tpl_t tpl_jle = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x8e, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jl JUMP
+static const p4_tpl_t tpl_jl = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x8c, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jae JUMP
+static const p4_tpl_t tpl_jae = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x83, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// ja JUMP
+static const p4_tpl_t tpl_ja = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x87, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jbe JUMP
+static const p4_tpl_t tpl_jbe = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x86, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// jb JUMP
+static const p4_tpl_t tpl_jb = {
+    6, { { 2, HOLE_JUMP } },
+    (const uint8_t[]) {
+        0x0f, 0x82, 0x00, 0x00, 0x00, 0x00,
+    }
+};
+
+// sub rbp,CELL; mov byte ptr [rbp],al
+static const p4_tpl_t tpl_rel = {
+    10, { { 3, HOLE_CELL } },
+    (const uint8_t[]) {
+        0x48, 0x81, 0xed, 0x00, 0x00, 0x00, 0x00, 0x88, 0x45, 0x00,
+    }
+};
+
+#endif /* P4_JIT_X64_H_ */
@@ -37,12 +37,25 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
 #include "p4_vm.h"
-#include "p4_functions.h"
+#include "p4_jit.h"
 #include "p4_file.h"
 
+#if defined(__linux__)
+
+#include <pthread.h>
+#include <signal.h>
+#include <setjmp.h>
+
+// p4_vm_run of this thread and its vm, fault is NULL while a standard procedure runs (Guards)
+static __thread sigjmp_buf *fault;
+static __thread p4_vm_t faultvm;
+
+#endif
+
 /* Note for the implementation.
  ===========================
  This interpreter is written for the case where all the fundamental types
@@ -56,41 +69,71 @@
  involved have already been taken into account.
  */
 
-static short ad;
-static bool b;
-static long i, i1, i2;
-
-static short base(p4_vm_t p4vm, long ld) {
-    short ad;
+/* Display.
+ ========
+ display[l] holds the data segment of the innermost active procedure at static
+ level l along the current static chain, so base(ld) is display[lv - ld] instead
+ of a walk over ld static links. mst computes the level of the called procedure
+ and stores it next to the static link, cup installs the new frame in the display
+ saving the entry it replaces next to the dynamic link, and ret restores it.
+ cup and ret check the levels and links they take from the store, and a level
+ ld beyond the one of the procedure (only in hand-written code) reads heap[],
+ which precedes the display in p4_vm_s and holds addresses in the store too.
+ */
 
-    ad = p4vm->mp;
-    while (ld > 0) {
-        ad = p4vm->store[ad + 1].vm;
-        ld--;
-    }
-    return ad;
+static int32_t base(p4_vm_t p4vm, long ld) {
+    return p4vm->display[p4vm->lv - ld];
 } // base
 
-static void compare(p4_vm_t p4vm, int16_t q) {
-    // comparing is only correct if result by comparing integers will be
-    i1 = p4vm->store[p4vm->sp].va;
-    i2 = p4vm->store[p4vm->sp + 1].va;
-    i = 0;
-    b = true;
-    while (b && i != q) {
-        if (p4vm->store[i1 + i].vi == p4vm->store[i2 + i].vi)
-            i++;
-        else
-            b = false;
-    }
+static bool compare(p4_vm_t p4vm, int32_t q, int *order) {
+    // order of the strings of q chars at the two addresses on top of the stack, < 0, 0 or > 0; false if one is not in the store
+    int32_t a = p4vm->store[p4vm->sp].va, b = p4vm->store[p4vm->sp + 1].va, n = (q + CHARCELL - 1) / CHARCELL;
+
+    if (q < 0 || !INSTORE(p4vm, a, n) || !INSTORE(p4vm, b, n))
+        return false;
+    *order = memcmp(&(p4vm->store[a]), &(p4vm->store[b]), q);
+    return true;
 } // compare
 
-static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
+// the links of the frame at mp lead back to a frame in the store, a level of the display and the code
+static bool linked(p4_vm_t p4vm, int32_t mp) {
+    int32_t dl = p4vm->store[mp + 2].vl.ad;
+
+    return (uint32_t) dl <= (uint32_t) p4vm->maxstk && (uint32_t) p4vm->store[mp + 2].vl.lv <= (uint32_t) p4vm->maxstk
+            && (uint32_t) p4vm->store[dl + 1].vl.lv < DISPLAYMAX && (uint32_t) p4vm->store[mp + 4].vm < p4vm->codelen;
+} // linked
+
+// the variable standard procedure q writes, or the chars wrs writes out, lies in the store
+static bool operand(p4_vm_t p4vm, int32_t q) {
+    rec_store_t *top = &(p4vm->store[p4vm->sp]);
+    int32_t n;
+
+    switch (q) {
+        case 4:  // new
+        case 11: // rdi
+        case 12: // rdr
+        case 13: // rdc
+            return INSTORE(p4vm, top[-1].va, 1);
+
+        case 21: // rdb
+            return INCHARS(p4vm, top[-1].va, 1);
+
+        case 6: // wrs
+            n = (top[-2].vi < top[-1].vi) ? top[-2].vi : top[-1].vi;
+            return n >= 0 && INSTORE(p4vm, top[-3].va, (n + CHARCELL - 1) / CHARCELL);
+
+        case 20: // sav
+            return INSTORE(p4vm, top[0].va, 1);
+    }
+    return true;
+} // operand
+
+uint8_t p4_vm_callsp(p4_vm_t p4vm, int32_t q, uint8_t op) {
 
     //////////// file access //////////////
 
     void readi(p4_vm_t p4vm, file_t *f) {
-        short ad;
+        int32_t ad;
 
         ad = p4vm->store[p4vm->sp - 1].va;
         fscanf(f->f, "%ld", (long int*) &(p4vm->store[ad].vi));
@@ -99,7 +142,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
     } // readi
 
     void readr(p4_vm_t p4vm, file_t *f) {
-        short ad;
+        int32_t ad;
 
         ad = p4vm->store[p4vm->sp - 1].va;
         fscanf(f->f, "%lg", &(p4vm->store[ad].vr));
@@ -107,15 +150,18 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
         p4vm->sp -= 2;
     } // readr
 
-    void readc(p4_vm_t p4vm, file_t *f) {
+    void readc(p4_vm_t p4vm, file_t *f, bool packed) {
         char c;
-        short ad;
+        int32_t ad;
 
         c = getc(f->f);
         if (c == '\n')
             c = ' ';
         ad = p4vm->store[p4vm->sp - 1].va;
-        p4vm->store[ad].vc = c;
+        if (packed) // ad is the byte address of a char of an array
+            CHARS(p4vm)[ad] = c;
+        else
+            p4vm->store[ad].vc = c;
         p4vm->store[p4vm->store[p4vm->sp].va].vc = p4_file_peek(f->f);
         p4vm->store[p4vm->store[p4vm->sp].va].vi = p4_file_peek(f->f);
         p4vm->sp -= 2;
@@ -123,7 +169,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
 
     void writestr(p4_vm_t p4vm, file_t *f) {
         long i, j, k;
-        short ad;
+        int32_t ad;
         long FORLIM;
 
         ad = p4vm->store[p4vm->sp - 3].va;
@@ -136,13 +182,12 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                 putc(' ', f->f);
         } else
             j = k;
-        for (i = 0; i < j; i++)
-            putc(p4vm->store[ad + i].vc, f->f);
+        fwrite(&(p4vm->store[ad]), 1, j, f->f);
         p4vm->sp -= 4;
     } // writestr
 
     void getfile(p4_vm_t p4vm, file_t *f) {
-        short ad;
+        int32_t ad;
 
         ad = p4vm->store[p4vm->sp].va;
         getc(f->f);
@@ -151,7 +196,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
     } // getfile
 
     void putfile(p4_vm_t p4vm, file_t *f) {
-        short ad;
+        int32_t ad;
 
         ad = p4vm->store[p4vm->sp].va;
         putc(p4vm->store[ad].vc, f->f);
@@ -161,15 +206,15 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
     ///////////////////////////////
 
     bool line = false;
-    file_t TEMP;
+    int32_t ad;
 
+    if (!operand(p4vm, q))
+        return VMFAULT;
     switch (q) {
         case 0: // get
             switch (p4vm->store[p4vm->sp].va) {
                 case 5:
-                    TEMP.f = stdin;
-                    *TEMP.name = '\0';
-                    getfile(p4vm, &TEMP);
+                    getfile(p4vm, &(p4vm->input));
                     break;
 
                 case 6:
@@ -194,9 +239,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 6:
-                    TEMP.f = stdout;
-                    *TEMP.name = '\0';
-                    putfile(p4vm, &TEMP);
+                    putfile(p4vm, &(p4vm->output));
                     break;
 
                 case 7:
@@ -211,7 +254,8 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
 
         case 2: // rst
             // for testphase
-            p4vm->np = p4vm->store[p4vm->sp].va;
+            if (!p4_heap_release(p4vm, p4vm->store[p4vm->sp].va))
+                return VMFAULT;
             p4vm->sp--;
             break;
 
@@ -219,9 +263,9 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
             switch (p4vm->store[p4vm->sp].va) {
 
                 case 5:
-                    scanf("%*[^\n]");
-                    getchar();
-                    p4vm->store[INPUTADR].vc = p4_file_peek(stdin);
+                    fscanf(p4vm->input.f, "%*[^\n]");
+                    getc(p4vm->input.f);
+                    p4vm->store[INPUTADR].vc = p4_file_peek(p4vm->input.f);
                     break;
 
                 case 6:
@@ -229,9 +273,9 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 7:
-                    scanf("%*[^\n]");
-                    getchar();
-                    p4vm->store[INPUTADR].vc = p4_file_peek(stdin);
+                    fscanf(p4vm->input.f, "%*[^\n]");
+                    getc(p4vm->input.f);
+                    p4vm->store[INPUTADR].vc = p4_file_peek(p4vm->input.f);
                     break;
 
                 case 8:
@@ -242,13 +286,12 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
             break;
 
         case 4: // new
-            ad = p4vm->np - p4vm->store[p4vm->sp].va;
             // top of stack gives the length in units of storage
-            if (ad <= p4vm->ep)
+            if ((ad = p4_heap_new(p4vm, p4vm->store[p4vm->sp].va)) == 0)
                 return op;
-            p4vm->np = ad;
-            ad = p4vm->store[p4vm->sp - 1].va;
-            p4vm->store[ad].va = p4vm->np;
+            if (ad < 0)
+                return VMFAULT;
+            p4vm->store[p4vm->store[p4vm->sp - 1].va].va = ad;
             p4vm->sp -= 2;
             break;
 
@@ -260,7 +303,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 6:
-                    putchar('\n');
+                    putc('\n', p4vm->output.f);
                     break;
 
                 case 7:
@@ -282,9 +325,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 6:
-                    TEMP.f = stdout;
-                    *TEMP.name = '\0';
-                    writestr(p4vm, &TEMP);
+                    writestr(p4vm, &(p4vm->output));
                     break;
 
                 case 7:
@@ -301,7 +342,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
             switch (p4vm->store[p4vm->sp].va) {
 
                 case 5:
-                    line = p4_file_eoln(stdin);
+                    line = p4_file_eoln(p4vm->input.f);
                     break;
 
                 case 6:
@@ -327,7 +368,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 6:
-                    printf("%*ld", (int) p4vm->store[p4vm->sp - 1].vi, (long int) p4vm->store[p4vm->sp - 2].vi);
+                    fprintf(p4vm->output.f, "%*ld", (int) p4vm->store[p4vm->sp - 1].vi, (long int) p4vm->store[p4vm->sp - 2].vi);
                     break;
 
                 case 7:
@@ -349,7 +390,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 6:
-                    printf("% .*E", (((int) p4vm->store[p4vm->sp - 1].vi - 7) > (1) ? ((int) p4vm->store[p4vm->sp - 1].vi - 7) : (1)),
+                    fprintf(p4vm->output.f, "% .*E", (((int) p4vm->store[p4vm->sp - 1].vi - 7) > (1) ? ((int) p4vm->store[p4vm->sp - 1].vi - 7) : (1)),
                             p4vm->store[p4vm->sp - 2].vr);
                     break;
 
@@ -373,7 +414,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 6:
-                    printf("%*c", (int) p4vm->store[p4vm->sp - 1].vi, p4vm->store[p4vm->sp - 2].vc);
+                    fprintf(p4vm->output.f, "%*c", (int) p4vm->store[p4vm->sp - 1].vi, p4vm->store[p4vm->sp - 2].vc);
                     break;
 
                 case 7:
@@ -391,9 +432,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
             switch (p4vm->store[p4vm->sp].va) {
 
                 case 5:
-                    TEMP.f = stdin;
-                    *TEMP.name = '\0';
-                    readi(p4vm, &TEMP);
+                    readi(p4vm, &(p4vm->input));
                     break;
 
                 case 6:
@@ -414,9 +453,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
             switch (p4vm->store[p4vm->sp].va) {
 
                 case 5:
-                    TEMP.f = stdin;
-                    *TEMP.name = '\0';
-                    readr(p4vm, &TEMP);
+                    readr(p4vm, &(p4vm->input));
                     break;
 
                 case 6:
@@ -434,12 +471,11 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
             break;
 
         case 13: // rdc
+        case 21: // rdb
             switch (p4vm->store[p4vm->sp].va) {
 
                 case 5:
-                    TEMP.f = stdin;
-                    *TEMP.name = '\0';
-                    readc(p4vm, &TEMP);
+                    readc(p4vm, &(p4vm->input), q == 21);
                     break;
 
                 case 6:
@@ -447,7 +483,7 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
                     break;
 
                 case 7:
-                    readc(p4vm, &(p4vm->prd));
+                    readc(p4vm, &(p4vm->prd), q == 21);
                     break;
 
                 case 8:
@@ -485,21 +521,44 @@ static uint8_t callsp(p4_vm_t p4vm, int16_t q, uint8_t op) {
             p4vm->store[ad].va = p4vm->np;
             p4vm->sp--;
             break;
+
+        case 22: // dsp
+            if (!p4_heap_dispose(p4vm, p4vm->store[p4vm->sp].va))
+                return op;
+            p4vm->sp--;
+            break;
     } // case q
 
     return 255;
+} // p4_vm_callsp
+
+// standard procedure q of a running program: it calls stdio, a fault in there is not caught
+static uint8_t callsp(p4_vm_t p4vm, int32_t q, uint8_t op) {
+#if defined(__linux__)
+    sigjmp_buf *env = fault;
+    uint8_t err;
+
+    fault = NULL;
+    err = p4_vm_callsp(p4vm, q, op);
+    fault = env;
+
+    return err;
+#else
+    return p4_vm_callsp(p4vm, q, op);
+#endif
 } // callsp
 
 uint8_t p4_vm_interpret(p4_vm_t p4vm) {
     rec_code_t *WITH;
-    settype SET;
     long TEMP;
     double TEMP1;
-    long FORLIM;
+    long i, i1, i2;
+    int32_t ad;
+    int order;
 
     uint8_t op; //
     uint8_t p;  //
-    int16_t q;  // instruction register
+    int32_t q;  // instruction register
 
     WITH = &(p4vm->code[p4vm->pc / 2]);
     // fetch
@@ -574,6 +633,8 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
         case 83:
         case 84:
         case 6: // sto
+            if (!INSTORE(p4vm, p4vm->store[p4vm->sp - 1].va, 1))
+                return VMFAULT;
             p4vm->store[p4vm->store[p4vm->sp - 1].va] = p4vm->store[p4vm->sp];
             p4vm->sp -= 2;
             break;
@@ -590,7 +651,7 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
                         p4vm->store[p4vm->sp].vb = (q == 1);
                     else
                         // load nil
-                        p4vm->store[p4vm->sp].va = MAXSTR;
+                        p4vm->store[p4vm->sp].va = MAXSTR(p4vm);
                 }
             }
             break;
@@ -608,6 +669,8 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
         case 9: // ind
             ad = p4vm->store[p4vm->sp].va + q;
             // q is a number of storage units
+            if (!INSTORE(p4vm, ad, 1))
+                return VMFAULT;
             p4vm->store[p4vm->sp] = p4vm->store[ad];
             break;
 
@@ -623,7 +686,8 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
         case 11: // mst
             // p=level of calling procedure minus level of called procedure + 1;  set dl and sl, increment sp
             // then length of this element is max(intsize,realsize,boolsize,charsize,ptrsize
-            p4vm->store[p4vm->sp + 2].vm = base(p4vm, p);
+            p4vm->store[p4vm->sp + 2].vl.ad = base(p4vm, p);
+            p4vm->store[p4vm->sp + 2].vl.lv = p4vm->lv + 1 - p;
             // the length of this element is ptrsize
             p4vm->store[p4vm->sp + 3].vm = p4vm->mp;
             // idem
@@ -636,14 +700,20 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
             // p=no of locations for parameters, q=entry point
             p4vm->mp = p4vm->sp - p - 4;
             p4vm->store[p4vm->mp + 4].vm = p4vm->pc;
+            if ((uint32_t) p4vm->store[p4vm->mp + 1].vl.lv >= DISPLAYMAX)
+                return VMFAULT;
+            p4vm->lv = p4vm->store[p4vm->mp + 1].vl.lv;
+            p4vm->store[p4vm->mp + 2].vl.lv = p4vm->display[p4vm->lv];
+            p4vm->display[p4vm->lv] = p4vm->mp;
             p4vm->pc = q;
             break;
 
         case 13: // ent
+            // the ep of ent 2, right after ent 1, is above its sp
             if (p == 1) {
+                if ((uint32_t) q > (uint32_t) p4vm->maxstk)
+                    return VMFAULT;
                 p4vm->sp = p4vm->mp + q; // q = length of dataseg
-                if (p4vm->sp > p4vm->np)
-                    return op;
             } else {
                 p4vm->ep = p4vm->sp + q;
                 if (p4vm->ep > p4vm->np)
@@ -653,6 +723,8 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
             // q = max space required on stack
 
         case 14: // ret
+            if (!linked(p4vm, p4vm->mp))
+                return VMFAULT;
             switch (p) {
 
                 case 0:
@@ -669,11 +741,13 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
             }
             p4vm->pc = p4vm->store[p4vm->mp + 4].vm;
             p4vm->ep = p4vm->store[p4vm->mp + 3].vm;
-            p4vm->mp = p4vm->store[p4vm->mp + 2].vm;
+            p4vm->display[p4vm->lv] = p4vm->store[p4vm->mp + 2].vl.lv;
+            p4vm->mp = p4vm->store[p4vm->mp + 2].vl.ad;
+            p4vm->lv = p4vm->store[p4vm->mp + 1].vl.lv;
             break;
 
         case 15: // csp
-            if (callsp(p4vm, q, op) != 255)
+            if ((op = callsp(p4vm, q, op)) != 255)
                 return op;
             break;
 
@@ -708,13 +782,17 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
                     break;
 
                 case 4:
-                    p4vm->store[p4vm->sp].vb = p4_fn_setequal(p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp + 1].vs);
+                    p4vm->store[p4vm->sp].vb = (p4vm->store[p4vm->sp].vs == p4vm->store[p4vm->sp + 1].vs);
                     break;
 
                 case 5:
-                    compare(p4vm, q);
-                    p4vm->store[p4vm->sp].vb = b;
+                    if (!compare(p4vm, q, &order))
+                        return VMFAULT;
+                    p4vm->store[p4vm->sp].vb = (order == 0);
                     break;
+
+                default:
+                    return op;
             } // case p
             break;
 
@@ -743,13 +821,17 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
                     break;
 
                 case 4:
-                    p4vm->store[p4vm->sp].vb = !p4_fn_setequal(p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp + 1].vs);
+                    p4vm->store[p4vm->sp].vb = (p4vm->store[p4vm->sp].vs != p4vm->store[p4vm->sp + 1].vs);
                     break;
 
                 case 5:
-                    compare(p4vm, q);
-                    p4vm->store[p4vm->sp].vb = !b;
+                    if (!compare(p4vm, q, &order))
+                        return VMFAULT;
+                    p4vm->store[p4vm->sp].vb = (order != 0);
                     break;
+
+                default:
+                    return op;
             } // case p
             break;
 
@@ -778,13 +860,17 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
                     break;
 
                 case 4:
-                    p4vm->store[p4vm->sp].vb = p4_fn_subset(p4vm->store[p4vm->sp + 1].vs, p4vm->store[p4vm->sp].vs);
+                    p4vm->store[p4vm->sp].vb = ((p4vm->store[p4vm->sp + 1].vs & ~p4vm->store[p4vm->sp].vs) == 0);
                     break;
 
                 case 5:
-                    compare(p4vm, q);
-                    p4vm->store[p4vm->sp].vb = (b || p4vm->store[i1 + i].vi >= p4vm->store[i2 + i].vi);
+                    if (!compare(p4vm, q, &order))
+                        return VMFAULT;
+                    p4vm->store[p4vm->sp].vb = (order >= 0);
                     break;
+
+                default:
+                    return op;
             } // case p
             break;
 
@@ -817,9 +903,13 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
                     break;
 
                 case 5:
-                    compare(p4vm, q);
-                    p4vm->store[p4vm->sp].vb = (!b && p4vm->store[i1 + i].vi > p4vm->store[i2 + i].vi);
+                    if (!compare(p4vm, q, &order))
+                        return VMFAULT;
+                    p4vm->store[p4vm->sp].vb = (order > 0);
                     break;
+
+                default:
+                    return op;
             } // case p
             break;
 
@@ -848,13 +938,17 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
                     break;
 
                 case 4:
-                    p4vm->store[p4vm->sp].vb = p4_fn_subset(p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp + 1].vs);
+                    p4vm->store[p4vm->sp].vb = ((p4vm->store[p4vm->sp].vs & ~p4vm->store[p4vm->sp + 1].vs) == 0);
                     break;
 
                 case 5:
-                    compare(p4vm, q);
-                    p4vm->store[p4vm->sp].vb = (b || p4vm->store[i1 + i].vi <= p4vm->store[i2 + i].vi);
+                    if (!compare(p4vm, q, &order))
+                        return VMFAULT;
+                    p4vm->store[p4vm->sp].vb = (order <= 0);
                     break;
+
+                default:
+                    return op;
             } // case p
             break;
 
@@ -883,9 +977,13 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
                     break;
 
                 case 5:
-                    compare(p4vm, q);
-                    p4vm->store[p4vm->sp].vb = (!b && p4vm->store[i1 + i].vi < p4vm->store[i2 + i].vi);
+                    if (!compare(p4vm, q, &order))
+                        return VMFAULT;
+                    p4vm->store[p4vm->sp].vb = (order < 0);
                     break;
+
+                default:
+                    return op;
             } // case p
             break;
 
@@ -905,7 +1003,7 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
             break;
 
         case 95: // chka
-            if (p4vm->store[p4vm->sp].va < p4vm->np || p4vm->store[p4vm->sp].va > MAXSTR - q)
+            if (p4vm->store[p4vm->sp].va < p4vm->np || p4vm->store[p4vm->sp].va > MAXSTR(p4vm) - q)
                 return op;
             break;
 
@@ -921,7 +1019,7 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
         case 27: // eof
             i = p4vm->store[p4vm->sp].vi;
             if (i == INPUTADR)
-                p4vm->store[p4vm->sp].vb = p4_file_eof(stdin);
+                p4vm->store[p4vm->sp].vb = p4_file_eof(p4vm->input.f);
             else
                 return op;
             break;
@@ -947,7 +1045,9 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
             break;
 
         case 32: // sgs
-            p4_fn_setcpy(p4vm->store[p4vm->sp].vs, p4_fn_addset(p4_fn_expset(SET, 0), p4vm->store[p4vm->sp].vi));
+            if ((uint32_t) p4vm->store[p4vm->sp].vi >= SETMAX)
+                return op;
+            p4vm->store[p4vm->sp].vs = (setbits_t) 1 << p4vm->store[p4vm->sp].vi;
             break;
 
         case 33: // flt
@@ -1004,23 +1104,23 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
 
         case 45: // dif
             p4vm->sp--;
-            p4_fn_setdiff(p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp + 1].vs);
+            p4vm->store[p4vm->sp].vs &= ~p4vm->store[p4vm->sp + 1].vs;
             break;
 
         case 46: // int
             p4vm->sp--;
-            p4_fn_setint(p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp + 1].vs);
+            p4vm->store[p4vm->sp].vs &= p4vm->store[p4vm->sp + 1].vs;
             break;
 
         case 47: // uni
             p4vm->sp--;
-            p4_fn_setunion(p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp].vs, p4vm->store[p4vm->sp + 1].vs);
+            p4vm->store[p4vm->sp].vs |= p4vm->store[p4vm->sp + 1].vs;
             break;
 
         case 48: // inn
             p4vm->sp--;
             i = p4vm->store[p4vm->sp].vi;
-            p4vm->store[p4vm->sp].vb = p4_fn_inset(i, p4vm->store[p4vm->sp + 1].vs);
+            p4vm->store[p4vm->sp].vb = ((uint64_t) i < SETMAX && ((p4vm->store[p4vm->sp + 1].vs >> i) & 1));
             break;
 
         case 49: // mod
@@ -1055,12 +1155,11 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
         case 55: // mov
             i1 = p4vm->store[p4vm->sp - 1].va;
             i2 = p4vm->store[p4vm->sp].va;
+            if (!INSTORE(p4vm, i1, q) || !INSTORE(p4vm, i2, q))
+                return VMFAULT;
             p4vm->sp -= 2;
-            FORLIM = q;
-            for (i = 0; i < FORLIM; i++) {
-                p4vm->store[i1 + i] = p4vm->store[i2 + i];
-                // q is a number of storage units
-            }
+            // q is a number of storage units
+            memmove(&(p4vm->store[i1]), &(p4vm->store[i2]), q * sizeof(rec_store_t));
             break;
 
         case 56: // lca
@@ -1091,7 +1190,1009 @@ uint8_t p4_vm_interpret(p4_vm_t p4vm) {
         case 61: // ujc
             return op;
             break;
+
+        case 62: // ixb
+            i = p4vm->store[p4vm->sp].vi;
+            p4vm->sp--;
+            p4vm->store[p4vm->sp].va = CHARADR(p4vm->store[p4vm->sp].va, i);
+            break;
+
+        case 63: // ldb
+            if (!INCHARS(p4vm, p4vm->store[p4vm->sp].va, 1))
+                return VMFAULT;
+            p4vm->store[p4vm->sp].vi = CHARS(p4vm)[p4vm->store[p4vm->sp].va];
+            break;
+
+        case 64: // stb
+            if (!INCHARS(p4vm, p4vm->store[p4vm->sp - 1].va, 1))
+                return VMFAULT;
+            CHARS(p4vm)[p4vm->store[p4vm->sp - 1].va] = p4vm->store[p4vm->sp].vc;
+            p4vm->sp -= 2;
+            break;
     }
 
     return 255;
 }
+
+/* Threaded run loop.
+ ==================
+ Same semantics as p4_vm_interpret but stays in this function until stp or an
+ error. It runs the predecoded insn[] stream built by p4_vm_decode, so a fetch
+ is a plain record load and jumps are direct indices into the stream.
+ pc (as the ip pointer), sp and mp are kept in locals and dispatch is done
+ through a table of label addresses (GCC computed goto), so every handler jumps
+ directly to the next one.
+
+ The top of the stack is cached in tos, a copy of the cell store[sp], which is
+ stale itself. Operations work on tos and the cell below it, pushes spill tos
+ and pops fill it again. The registers are written back to p4vm, and tos to the
+ store, before any helper that reads them (p4_vm_callsp, compare) and on exit,
+ so the store can be inspected as usual.
+ */
+
+#define LOAD(ad)     (tos = store[ad])
+#define STORE(ad)    (store[ad] = tos)
+#define SPILL()      STORE(sp)
+#define FILL()       LOAD(sp)
+
+#define SAVE_REGS()              \
+    do {                         \
+        if (sp >= 0)             \
+            SPILL();             \
+        p4vm->pc = ip - insn;    \
+        p4vm->sp = sp;           \
+        p4vm->mp = mp;           \
+        p4vm->lv = lv;           \
+    } while (0)
+
+// op is not kept while running, a failing handler reads it back from the record it came from
+#define NEXT()                                 \
+    do {                                       \
+        p = ip->p;                             \
+        q = ip->q;                             \
+        goto *dispatch[(ip++)->op];            \
+    } while (0)
+
+// stop with the status in op
+#define STOP()              \
+    do {                    \
+        SAVE_REGS();        \
+        return op;          \
+    } while (0)
+
+#define FAIL()              \
+    do {                    \
+        op = ip[-1].op;     \
+        STOP();             \
+    } while (0)
+
+// an access outside the store (Guards)
+#define FAULT()             \
+    do {                    \
+        op = VMFAULT;       \
+        STOP();             \
+    } while (0)
+
+// binary scalar operation: left operand in the store, right operand and result in tos
+#define BINOP(v, expr)                        \
+    do {                                      \
+        sp--;                                 \
+        tos.v = (expr);                       \
+        NEXT();                               \
+    } while (0)
+
+#define RELOP(v, rel)      BINOP(vb, store[sp].v rel tos.v)
+
+// continue after the records covered by a fused instruction
+#define SKIP()    (ip += ip[-1].w - 1)
+
+// fused integer compare and fjp, the jump target of VARJ/CONJ is kept in the first covered record
+#define CMPJ(rel)                                          \
+    do {                                                   \
+        sp -= 2;                                           \
+        from = ip;                                         \
+        if (store[sp + 1].vi rel tos.vi)                   \
+            SKIP();                                        \
+        else                                               \
+            ip = insn + q;                                 \
+        FILL();                                            \
+        LOOP(from);                                        \
+        NEXT();                                            \
+    } while (0)
+
+#define VARJ(rel)                                                                          \
+    do {                                                                                   \
+        from = ip;                                                                         \
+        if (store[((p & 1) ? mp : 0) + q].vi rel store[((p & 2) ? mp : 0) + ip[-1].r].vi)  \
+            SKIP();                                                                        \
+        else                                                                               \
+            ip = insn + ip->q;                                                             \
+        LOOP(from);                                                                        \
+        NEXT();                                                                            \
+    } while (0)
+
+#define CONJ(rel)                                                  \
+    do {                                                           \
+        from = ip;                                                 \
+        if (store[((p & 1) ? mp : 0) + q].vi rel ip[-1].r)         \
+            SKIP();                                                \
+        else                                                       \
+            ip = insn + ip->q;                                     \
+        LOOP(from);                                                \
+        NEXT();                                                    \
+    } while (0)
+
+#define BASE(ld)    display[lv - (ld)]
+
+// a cell of the store, against the bound run keeps in a register
+#define INCELL(ad)  ((uint32_t) (ad) < nil)
+
+// registers back from p4vm after native code ran
+#define LOAD_REGS()                  \
+    do {                             \
+        ip = insn + p4vm->pc;        \
+        sp = p4vm->sp;               \
+        mp = p4vm->mp;               \
+        lv = p4vm->lv;               \
+        if (sp >= 0)                 \
+            FILL();                  \
+    } while (0)
+
+// procedure entries and return addresses continue in native code if the jit has (or makes) some
+#define JIT()                                   \
+    do {                                        \
+        if (p4vm->jit != NULL)                  \
+            goto jit_call;                      \
+    } while (0)
+
+// a backward jump to ip: count it for the loop head and run its trace once it is hot
+#define LOOP(from)                              \
+    do {                                        \
+        if (ip < (from) && p4vm->jit != NULL)   \
+            goto jit_loop;                      \
+    } while (0)
+
+static uint8_t run(p4_vm_t p4vm) {
+    static const void *const dispatch[OP_LAST + 1] = {
+        [0] = &&op_lod,
+        [1] = &&op_ldo,
+        [2] = &&op_str,
+        [3] = &&op_sro,
+        [4] = &&op_lda,
+        [5] = &&op_lao,
+        [6] = &&op_sto,
+        [7] = &&op_ldc,
+        [8] = &&op_lci,
+        [9] = &&op_ind,
+        [10] = &&op_inc,
+        [11] = &&op_mst,
+        [12] = &&op_cup,
+        [13] = &&op_ent,
+        [14] = &&op_ret,
+        [15] = &&op_csp,
+        [16] = &&op_ixa,
+        [17 ... 22] = &&op_relx,
+        [23] = &&op_ujp,
+        [24] = &&op_fjp,
+        [25] = &&op_xjp,
+        [26] = &&op_chk,
+        [27] = &&op_eof,
+        [28] = &&op_adi,
+        [29] = &&op_adr,
+        [30] = &&op_sbi,
+        [31] = &&op_sbr,
+        [32] = &&op_sgs,
+        [33] = &&op_flt,
+        [34] = &&op_flo,
+        [35] = &&op_trc,
+        [36] = &&op_ngi,
+        [37] = &&op_ngr,
+        [38] = &&op_sqi,
+        [39] = &&op_sqr,
+        [40] = &&op_abi,
+        [41] = &&op_abr,
+        [42] = &&op_not,
+        [43] = &&op_and,
+        [44] = &&op_ior,
+        [45] = &&op_dif,
+        [46] = &&op_int,
+        [47] = &&op_uni,
+        [48] = &&op_inn,
+        [49] = &&op_mod,
+        [50] = &&op_odd,
+        [51] = &&op_mpi,
+        [52] = &&op_mpr,
+        [53] = &&op_dvi,
+        [54] = &&op_dvr,
+        [55] = &&op_mov,
+        [56] = &&op_lca,
+        [57] = &&op_dec,
+        [58] = &&op_stp,
+        [59] = &&op_ord,
+        [60] = &&op_chr,
+        [61] = &&op_ujc,
+        [62] = &&op_ixb,
+        [63] = &&op_ldb,
+        [64] = &&op_stb,
+        [65 ... 66] = &&op_ldo, [67] = &&op_ldos, [68 ... 69] = &&op_ldo,
+        [70 ... 71] = &&op_str, [72] = &&op_strs, [73 ... 74] = &&op_str,
+        [75 ... 76] = &&op_sro, [77] = &&op_sros, [78 ... 79] = &&op_sro,
+        [80 ... 81] = &&op_sto, [82] = &&op_stos, [83 ... 84] = &&op_sto,
+        [85 ... 86] = &&op_ind, [87] = &&op_inds, [88 ... 89] = &&op_ind,
+        [90 ... 94] = &&op_inc,
+        [95] = &&op_chka,
+        [96 ... 99] = &&op_chk,
+        [100 ... 104] = &&op_dec,
+        [105 ... 106] = &&op_lod, [107] = &&op_lods, [108 ... 109] = &&op_lod,
+        [OP_INCL] = &&op_incl,
+        [OP_INCO] = &&op_inco,
+        [OP_IXAD] = &&op_ixad,
+        [OP_IXLD] = &&op_ixld,
+        [OP_CMPJ + 0] = &&op_cmpj_equ,
+        [OP_CMPJ + 1] = &&op_cmpj_neq,
+        [OP_CMPJ + 2] = &&op_cmpj_geq,
+        [OP_CMPJ + 3] = &&op_cmpj_grt,
+        [OP_CMPJ + 4] = &&op_cmpj_leq,
+        [OP_CMPJ + 5] = &&op_cmpj_les,
+        [OP_VARJ + 0] = &&op_varj_equ,
+        [OP_VARJ + 1] = &&op_varj_neq,
+        [OP_VARJ + 2] = &&op_varj_geq,
+        [OP_VARJ + 3] = &&op_varj_grt,
+        [OP_VARJ + 4] = &&op_varj_leq,
+        [OP_VARJ + 5] = &&op_varj_les,
+        [OP_CONJ + 0] = &&op_conj_equ,
+        [OP_CONJ + 1] = &&op_conj_neq,
+        [OP_CONJ + 2] = &&op_conj_geq,
+        [OP_CONJ + 3] = &&op_conj_grt,
+        [OP_CONJ + 4] = &&op_conj_leq,
+        [OP_CONJ + 5] = &&op_conj_les,
+        [OP_RELOP + 0] = &&op_equa,
+        [OP_RELOP + 1] = &&op_equi,
+        [OP_RELOP + 2] = &&op_equr,
+        [OP_RELOP + 3] = &&op_equb,
+        [OP_RELOP + 4] = &&op_equs,
+        [OP_RELOP + 5] = &&op_equm,
+        [OP_RELOP + 6] = &&op_equc,
+        [OP_RELOP + 7] = &&op_neqa,
+        [OP_RELOP + 8] = &&op_neqi,
+        [OP_RELOP + 9] = &&op_neqr,
+        [OP_RELOP + 10] = &&op_neqb,
+        [OP_RELOP + 11] = &&op_neqs,
+        [OP_RELOP + 12] = &&op_neqm,
+        [OP_RELOP + 13] = &&op_neqc,
+        [OP_RELOP + 14] = &&op_relx,
+        [OP_RELOP + 15] = &&op_geqi,
+        [OP_RELOP + 16] = &&op_geqr,
+        [OP_RELOP + 17] = &&op_geqb,
+        [OP_RELOP + 18] = &&op_geqs,
+        [OP_RELOP + 19] = &&op_geqm,
+        [OP_RELOP + 20] = &&op_geqc,
+        [OP_RELOP + 21] = &&op_relx,
+        [OP_RELOP + 22] = &&op_grti,
+        [OP_RELOP + 23] = &&op_grtr,
+        [OP_RELOP + 24] = &&op_grtb,
+        [OP_RELOP + 25] = &&op_relx,
+        [OP_RELOP + 26] = &&op_grtm,
+        [OP_RELOP + 27] = &&op_grtc,
+        [OP_RELOP + 28] = &&op_relx,
+        [OP_RELOP + 29] = &&op_leqi,
+        [OP_RELOP + 30] = &&op_leqr,
+        [OP_RELOP + 31] = &&op_leqb,
+        [OP_RELOP + 32] = &&op_leqs,
+        [OP_RELOP + 33] = &&op_leqm,
+        [OP_RELOP + 34] = &&op_leqc,
+        [OP_RELOP + 35] = &&op_relx,
+        [OP_RELOP + 36] = &&op_lesi,
+        [OP_RELOP + 37] = &&op_lesr,
+        [OP_RELOP + 38] = &&op_lesb,
+        [OP_RELOP + 39] = &&op_relx,
+        [OP_RELOP + 40] = &&op_lesm,
+        [OP_RELOP + 41] = &&op_lesc,
+    };
+
+    rec_insn_t *insn = p4vm->insn;
+    rec_insn_t *ip = insn + p4vm->pc;
+    rec_insn_t *from; // address of a jump, to tell loops
+    rec_store_t *store = p4vm->store;
+    long TEMP;
+    int32_t ad;
+    int32_t link; // display entry restored by ret
+    int order;
+
+    int32_t *display = p4vm->display;
+    const uint32_t nil = MAXSTR(p4vm);       // cells of the store
+    const uint32_t top = p4vm->maxstk;       // last cell a frame can start at
+    const uint32_t codelen = p4vm->codelen;  // bound of the return addresses
+    int32_t sp = p4vm->sp;
+    int32_t mp = p4vm->mp;
+    int16_t lv = p4vm->lv;
+    rec_store_t tos;
+
+    uint32_t op; //
+     int32_t p;  //
+     int32_t q;  // instruction register
+
+    if (sp >= 0)
+        FILL();
+    NEXT();
+
+    op_lod:
+        SPILL();
+        sp++;
+        LOAD(BASE(p) + q);
+        NEXT();
+
+    op_lods:
+        SPILL();
+        sp++;
+        store[sp] = store[BASE(p) + q];
+        FILL();
+        NEXT();
+
+    op_ldo:
+        SPILL();
+        sp++;
+        LOAD(q);
+        NEXT();
+
+    op_ldos:
+        SPILL();
+        sp++;
+        store[sp] = store[q];
+        FILL();
+        NEXT();
+
+    op_str:
+        STORE(BASE(p) + q);
+        sp--;
+        FILL();
+        NEXT();
+
+    op_strs:
+        SPILL();
+        store[BASE(p) + q] = store[sp];
+        sp--;
+        FILL();
+        NEXT();
+
+    op_sro:
+        STORE(q);
+        sp--;
+        FILL();
+        NEXT();
+
+    op_sros:
+        SPILL();
+        store[q] = store[sp];
+        sp--;
+        FILL();
+        NEXT();
+
+    op_lda:
+        SPILL();
+        sp++;
+        tos.va = BASE(p) + q;
+        NEXT();
+
+    op_lao:
+        SPILL();
+        sp++;
+        tos.va = q;
+        NEXT();
+
+    op_sto:
+        if (!INCELL(store[sp - 1].va))
+            FAULT();
+        STORE(store[sp - 1].va);
+        sp -= 2;
+        FILL();
+        NEXT();
+
+    op_stos:
+        if (!INCELL(store[sp - 1].va))
+            FAULT();
+        SPILL();
+        store[store[sp - 1].va] = store[sp];
+        sp -= 2;
+        FILL();
+        NEXT();
+
+    op_ldc:
+        // whole cells, a member alone would keep the bytes of the cell before
+        SPILL();
+        sp++;
+        if (p == 1)
+            tos = (rec_store_t) { .vi = q };
+        else if (p == 6)
+            tos = (rec_store_t) { .vc = q };
+        else if (p == 3)
+            tos = (rec_store_t) { .vb = (q == 1) };
+        else
+            // load nil
+            tos = (rec_store_t) { .va = nil };
+        NEXT();
+
+    op_lci:
+        SPILL();
+        sp++;
+        store[sp] = store[q];
+        FILL();
+        NEXT();
+
+    op_ind:
+        // q is a number of storage units
+        ad = tos.va + q;
+        if (!INCELL(ad))
+            FAULT();
+        LOAD(ad);
+        NEXT();
+
+    op_inds:
+        ad = tos.va + q;
+        if (!INCELL(ad))
+            FAULT();
+        store[sp] = store[ad];
+        FILL();
+        NEXT();
+
+    op_inc:
+        tos.vi += q;
+        NEXT();
+
+    op_mst:
+        // p=level of calling procedure minus level of called procedure + 1;  set dl and sl, increment sp
+        if (sp >= 0)
+            SPILL();
+        store[sp + 2].vl.ad = BASE(p);
+        store[sp + 2].vl.lv = lv + 1 - p;
+        store[sp + 3].vm = mp;
+        store[sp + 4].vm = p4vm->ep;
+        sp += 5;
+        NEXT();
+
+    op_cup:
+        // p=no of locations for parameters, q=entry point
+        SPILL();
+        mp = sp - p - 4;
+        store[mp + 4].vm = ip - insn;
+        lv = store[mp + 1].vl.lv;
+        if ((uint16_t) lv >= DISPLAYMAX)
+            FAULT();
+        store[mp + 2].vl.lv = display[lv];
+        display[lv] = mp;
+        ip = insn + q;
+        JIT();
+        NEXT();
+
+    op_ent:
+        // q = length of dataseg / max space required on stack
+        // the ep of ent 2, right after ent 1, is above its sp
+        if (p == 1) {
+            if ((uint32_t) q > top)
+                FAULT();
+            sp = mp + q;
+            FILL();
+        } else {
+            p4vm->ep = sp + q;
+            if (p4vm->ep > p4vm->np)
+                FAIL();
+        }
+        NEXT();
+
+    op_ret:
+        // each link is read once and checked as in linked: a frame in the store, the code, a level of the display
+        ad = store[mp + 2].vl.ad;
+        link = store[mp + 2].vl.lv;
+        TEMP = store[mp + 4].vm;
+        if ((uint32_t) ad > top || (uint32_t) link > top || (uint32_t) TEMP >= codelen)
+            FAULT();
+        sp = (p == 0) ? mp - 1 : mp;
+        ip = insn + TEMP;
+        p4vm->ep = store[mp + 3].vm;
+        display[lv] = link;
+        mp = ad;
+        lv = store[mp + 1].vl.lv;
+        if ((uint16_t) lv >= DISPLAYMAX)
+            FAULT();
+        if (sp >= 0)
+            FILL();
+        JIT();
+        NEXT();
+
+    op_csp:
+        SAVE_REGS();
+        if ((op = callsp(p4vm, q, 15)) != 255)
+            return op;
+        sp = p4vm->sp;
+        FILL();
+        NEXT();
+
+    op_ixa:
+        TEMP = tos.vi;
+        sp--;
+        FILL();
+        tos.va += q * TEMP;
+        NEXT();
+
+    // comparisons, expanded by operand type in p4_vm_decode
+    op_equa:    RELOP(va, ==);
+    op_equi:    RELOP(vi, ==);
+    op_equr:    RELOP(vr, ==);
+    op_equb:    RELOP(vb, ==);
+    op_equc:    RELOP(vc, ==);
+
+    op_equs:    RELOP(vs, ==);
+
+    op_equm:
+        SPILL();
+        sp--;
+        p4vm->sp = sp;
+        if (!compare(p4vm, q, &order))
+            FAULT();
+        tos.vb = (order == 0);
+        NEXT();
+
+    op_neqa:    RELOP(va, !=);
+    op_neqi:    RELOP(vi, !=);
+    op_neqr:    RELOP(vr, !=);
+    op_neqb:    RELOP(vb, !=);
+    op_neqc:    RELOP(vc, !=);
+
+    op_neqs:    RELOP(vs, !=);
+
+    op_neqm:
+        SPILL();
+        sp--;
+        p4vm->sp = sp;
+        if (!compare(p4vm, q, &order))
+            FAULT();
+        tos.vb = (order != 0);
+        NEXT();
+
+    op_geqi:    RELOP(vi, >=);
+    op_geqr:    RELOP(vr, >=);
+    op_geqb:    RELOP(vb, >=);
+    op_geqc:    RELOP(vc, >=);
+
+    op_geqs:
+        BINOP(vb, (tos.vs & ~store[sp].vs) == 0);
+
+    op_geqm:
+        SPILL();
+        sp--;
+        p4vm->sp = sp;
+        if (!compare(p4vm, q, &order))
+            FAULT();
+        tos.vb = (order >= 0);
+        NEXT();
+
+    op_grti:    RELOP(vi, >);
+    op_grtr:    RELOP(vr, >);
+    op_grtb:    RELOP(vb, >);
+    op_grtc:    RELOP(vc, >);
+
+    op_grtm:
+        SPILL();
+        sp--;
+        p4vm->sp = sp;
+        if (!compare(p4vm, q, &order))
+            FAULT();
+        tos.vb = (order > 0);
+        NEXT();
+
+    op_leqi:    RELOP(vi, <=);
+    op_leqr:    RELOP(vr, <=);
+    op_leqb:    RELOP(vb, <=);
+    op_leqc:    RELOP(vc, <=);
+
+    op_leqs:
+        BINOP(vb, (store[sp].vs & ~tos.vs) == 0);
+
+    op_leqm:
+        SPILL();
+        sp--;
+        p4vm->sp = sp;
+        if (!compare(p4vm, q, &order))
+            FAULT();
+        tos.vb = (order <= 0);
+        NEXT();
+
+    op_lesi:    RELOP(vi, <);
+    op_lesr:    RELOP(vr, <);
+    op_lesb:    RELOP(vb, <);
+    op_lesc:    RELOP(vc, <);
+
+    op_lesm:
+        SPILL();
+        sp--;
+        p4vm->sp = sp;
+        if (!compare(p4vm, q, &order))
+            FAULT();
+        tos.vb = (order < 0);
+        NEXT();
+
+    op_ujp:
+        from = ip;
+        ip = insn + q;
+        LOOP(from);
+        NEXT();
+
+    op_fjp:
+        from = ip;
+        if (!tos.vb)
+            ip = insn + q;
+        sp--;
+        FILL();
+        LOOP(from);
+        NEXT();
+
+    op_xjp:
+        ip = insn + tos.vi + q;
+        sp--;
+        FILL();
+        NEXT();
+
+    op_chka:
+        if (tos.va < p4vm->np || tos.va > (int32_t) nil - q)
+            FAIL();
+        NEXT();
+
+    op_chk:
+        if (tos.vi < store[q - 1].vi || tos.vi > store[q].vi)
+            FAIL();
+        NEXT();
+
+    op_eof:
+        if (tos.vi != INPUTADR)
+            FAIL();
+        tos.vb = p4_file_eof(p4vm->input.f);
+        NEXT();
+
+    op_adi:
+        BINOP(vi, store[sp].vi + tos.vi);
+
+    op_adr:
+        BINOP(vr, store[sp].vr + tos.vr);
+
+    op_sbi:
+        BINOP(vi, store[sp].vi - tos.vi);
+
+    op_sbr:
+        BINOP(vr, store[sp].vr - tos.vr);
+
+    op_sgs:
+        if ((uint32_t) tos.vi >= SETMAX)
+            FAIL();
+        tos.vs = (setbits_t) 1 << tos.vi;
+        NEXT();
+
+    op_flt:
+        tos.vr = tos.vi;
+        NEXT();
+
+    op_flo:
+        store[sp - 1].vr = store[sp - 1].vi;
+        NEXT();
+
+    op_trc:
+        tos.vi = (long) tos.vr;
+        NEXT();
+
+    op_ngi:
+        tos.vi = -tos.vi;
+        NEXT();
+
+    op_ngr:
+        tos.vr = -tos.vr;
+        NEXT();
+
+    op_sqi:
+        tos.vi = tos.vi * tos.vi;
+        NEXT();
+
+    op_sqr:
+        tos.vr = tos.vr * tos.vr;
+        NEXT();
+
+    op_abi:
+        tos.vi = labs(tos.vi);
+        NEXT();
+
+    op_abr:
+        tos.vr = fabs(tos.vr);
+        NEXT();
+
+    op_not:
+        tos.vb = !tos.vb;
+        NEXT();
+
+    op_and:
+        BINOP(vb, store[sp].vb && tos.vb);
+
+    op_ior:
+        BINOP(vb, store[sp].vb || tos.vb);
+
+    op_dif:
+        BINOP(vs, store[sp].vs & ~tos.vs);
+
+    op_int:
+        BINOP(vs, store[sp].vs & tos.vs);
+
+    op_uni:
+        BINOP(vs, store[sp].vs | tos.vs);
+
+    op_inn:
+        BINOP(vb, (uint32_t) store[sp].vi < SETMAX && ((tos.vs >> store[sp].vi) & 1));
+
+    op_mod:
+        BINOP(vi, store[sp].vi % tos.vi);
+
+    op_odd:
+        tos.vb = tos.vi & 1;
+        NEXT();
+
+    op_mpi:
+        BINOP(vi, store[sp].vi * tos.vi);
+
+    op_mpr:
+        BINOP(vr, store[sp].vr * tos.vr);
+
+    op_dvi:
+        BINOP(vi, store[sp].vi / tos.vi);
+
+    op_dvr:
+        BINOP(vr, store[sp].vr / tos.vr);
+
+    op_mov:
+        // q is a number of storage units
+        if (!INSTORE(p4vm, store[sp - 1].va, q) || !INSTORE(p4vm, tos.va, q))
+            FAULT();
+        memmove(&store[store[sp - 1].va], &store[tos.va], q * sizeof(rec_store_t));
+        sp -= 2;
+        FILL();
+        NEXT();
+
+    op_lca:
+        SPILL();
+        sp++;
+        tos.va = q;
+        NEXT();
+
+    op_dec:
+        tos.vi -= q;
+        NEXT();
+
+    op_stp:
+        SAVE_REGS();
+        p4vm->run = false;
+        return 255;
+
+    // arrays of char, a char to a byte
+    op_ixb:
+        TEMP = tos.vi;
+        sp--;
+        FILL();
+        tos.va = CHARADR(tos.va, TEMP);
+        NEXT();
+
+    op_ldb:
+        if (!INCHARS(p4vm, tos.va, 1))
+            FAULT();
+        tos.vi = ((uint8_t*) store)[tos.va];
+        NEXT();
+
+    op_stb:
+        if (!INCHARS(p4vm, store[sp - 1].va, 1))
+            FAULT();
+        ((uint8_t*) store)[store[sp - 1].va] = tos.vc;
+        sp -= 2;
+        FILL();
+        NEXT();
+
+    op_ord:
+    op_chr:
+        // only used to change the tagfield
+        NEXT();
+
+    // fused instructions: ip points past the first covered record, ip[-1] is the fused record
+    op_incl:
+        store[BASE(p) + q].vi += ip[-1].r;
+        SKIP();
+        NEXT();
+
+    op_inco:
+        store[q].vi += ip[-1].r;
+        SKIP();
+        NEXT();
+
+    op_ixad:
+    op_ixld: {
+        // ip[0] holds the bounds (0 if unchecked), element size and ind offset
+        long x = store[((p & 2) ? mp : 0) + ip[-1].r].vi;
+        if (ip->p != 0 && (x < store[ip->p - 1].vi || x > store[ip->p].vi)) {
+            ip += 2;
+            op = 26;
+            STOP();
+        }
+        ad = ((p & 1) ? mp : 0) + q + ip->q * x;
+        if (ip[-1].op == OP_IXLD && !INCELL(ad + ip->r))
+            FAULT();
+        SPILL();
+        sp++;
+        if (ip[-1].op == OP_IXLD)
+            LOAD(ad + ip->r);
+        else
+            tos.va = ad;
+        SKIP();
+        NEXT();
+    }
+
+    op_cmpj_equ: CMPJ(==);
+    op_cmpj_neq: CMPJ(!=);
+    op_cmpj_geq: CMPJ(>=);
+    op_cmpj_grt: CMPJ(>);
+    op_cmpj_leq: CMPJ(<=);
+    op_cmpj_les: CMPJ(<);
+
+    op_varj_equ: VARJ(==);
+    op_varj_neq: VARJ(!=);
+    op_varj_geq: VARJ(>=);
+    op_varj_grt: VARJ(>);
+    op_varj_leq: VARJ(<=);
+    op_varj_les: VARJ(<);
+
+    op_conj_equ: CONJ(==);
+    op_conj_neq: CONJ(!=);
+    op_conj_geq: CONJ(>=);
+    op_conj_grt: CONJ(>);
+    op_conj_leq: CONJ(<=);
+    op_conj_les: CONJ(<);
+
+    op_ujc:
+        FAIL();
+
+    op_relx:
+        // a compare on an operand type it has no order for, reported as the interpreter does
+        op = ip[-1].op;
+        if (op >= OP_RELOP)
+            op = 17 + (op - OP_RELOP) / 7;
+        STOP();
+
+    // native code (p4_jit)
+    jit_call:
+        // the store is up to date here (cup has spilled, ret has filled)
+        if (!(p4vm->jit->tier & JIT_METHOD))
+            NEXT();
+        p4vm->pc = ip - insn;
+        p4vm->sp = sp;
+        p4vm->mp = mp;
+        p4vm->lv = lv;
+        if ((op = p4_jit_exec(p4vm)) != 255)
+            return op;
+        goto jit_back;
+
+    jit_loop:
+        if (!(p4vm->jit->tier & JIT_TRACE))
+            NEXT();
+        if (p4vm->jit->trace[ip - insn] == NULL && ++p4vm->jit->hot[ip - insn] != HOTLOOP)
+            NEXT();
+        SAVE_REGS();
+        if ((op = p4_jit_loop(p4vm)) != 255)
+            return op;
+
+    jit_back:
+        if (!p4vm->run)
+            return 255;
+        LOAD_REGS();
+        NEXT();
+}
+
+/* Guards.
+ =======
+ Every address a program computes is checked before the store is accessed
+ there: sto, ind, mov, ldb, stb, the string comparisons and the variables of
+ standard procedures (operand), and the links of a frame at cup and ret. A
+ failed check ends the program with VMFAULT. What is left are the cells at a
+ fixed offset from the stack and the frames, which a vm made by p4_vm_new
+ keeps in a reservation from P4_VM_GUARD bytes before it to P4_VM_REACH after
+ its start (p4_clone), so a program that runs off its store (hand-written code,
+ a stack beyond ep) faults in a guard. The SIGSEGV handler, installed by the
+ first p4_vm_run, jumps back to the p4_vm_run of the thread, which returns
+ VMFAULT as well. Only faults of the interpreter and the native code are taken:
+ standard procedures run with the handler disarmed, since a jump out of stdio
+ would leave its locks held. Any other fault goes to the handler found at the
+ install, or kills the process as it would have without one. Stack and heap
+ share the store and the bound between them moves with every new and call, so
+ ent 2 and new keep their compare of ep with np; only the one of ent 1, whose
+ ep is checked by the ent 2 after it, is gone. A fixed split with a guard
+ between the two would catch a collision without the compare, but it would fix
+ the sizes of stack and heap for every program, which the store of p4 leaves
+ to the program, so it is not done. run keeps the bounds it checks against in
+ locals and reads the links of a frame once at ret.
+ */
+
+#if defined(__linux__)
+
+static struct sigaction segv_old;
+static pthread_once_t segv_once = PTHREAD_ONCE_INIT;
+
+static void segv(int sig, siginfo_t *si, void *ctx) {
+    uintptr_t ad = (uintptr_t) si->si_addr, vm = (uintptr_t) faultvm;
+
+    if (fault != NULL && ad >= vm - P4_VM_GUARD && ad < vm + P4_VM_REACH(faultvm))
+        siglongjmp(*fault, 1);
+
+    if (segv_old.sa_flags & SA_SIGINFO)
+        segv_old.sa_sigaction(sig, si, ctx);
+    else if (segv_old.sa_handler != SIG_DFL && segv_old.sa_handler != SIG_IGN)
+        segv_old.sa_handler(sig);
+    else {
+        // delivered again once the handler returns
+        signal(SIGSEGV, SIG_DFL);
+        raise(SIGSEGV);
+    }
+} // segv
+
+static void install(void) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = segv;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &segv_old);
+} // install
+
+uint8_t p4_vm_run(p4_vm_t p4vm) {
+    sigjmp_buf env, *outer = fault;
+    p4_vm_t outervm = faultvm;
+    volatile uint8_t status = VMFAULT;
+
+    pthread_once(&segv_once, install);
+    // the signal mask is saved, siglongjmp unblocks SIGSEGV again
+    if (sigsetjmp(env, 1) == 0) {
+        fault = &env;
+        faultvm = p4vm;
+        status = run(p4vm);
+    } else
+        p4vm->run = false;
+    fault = outer;
+    faultvm = outervm;
+
+    return status;
+} // p4_vm_run
+
+#else
+
+uint8_t p4_vm_run(p4_vm_t p4vm) {
+    return run(p4vm);
+} // p4_vm_run
+
+#endif
+
+void p4_vm_decode(p4_vm_t p4vm) {
+    // expand the packed code pairs into one aligned record per instruction
+    rec_code_t *WITH;
+    rec_insn_t *insn;
+    uint32_t pc;
+
+    for (pc = 0; pc < p4vm->codelen; pc++) {
+        WITH = &(p4vm->code[pc / 2]);
+        insn = &(p4vm->insn[pc]);
+        if (pc & 1) {
+            insn->op = WITH->op2;
+            insn->p = WITH->p2;
+            insn->q = WITH->q2;
+        } else {
+            insn->op = WITH->op1;
+            insn->p = WITH->p1;
+            insn->q = WITH->q1;
+        }
+        if (insn->op >= 17 && insn->op <= 22 && insn->p <= 6) {
+            // comparisons get one opcode per operand type
+            insn->op = OP_RELOP + 7 * (insn->op - 17) + insn->p;
+        }
+        insn->w = 1;
+        insn->r = 0;
+    }
+} // p4_vm_decode
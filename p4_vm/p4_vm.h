@@ -39,57 +39,158 @@
 
 #include "p4_file.h"
 
-#define CODEMAX    8650
-#define PCMAX      17500
-#define MAXSTK     13650   // size of variable store
-#define OVERI      13655   // size of integer constant table = 5
-#define OVERR      13660   // size of real constant table = 5
-#define OVERS      13730   // size of set constant table = 70
-#define OVERB      13820
-#define OVERM      18000
-#define MAXSTR     18001
-#define LARGEINT   26144
+#define CODELEN    16384   // instructions the image of p4_vm_new holds, p4_vm_reserve makes it larger
+#define PCMAX      (INT32_MAX / 32) // instructions of the largest program
+#define STOREMAX   13650   // default size of variable store (p4_vm_new)
+#define CONSTPOOL  512     // cells of the constant pool of p4_vm_new, p4_vm_grow makes it larger
+#define CONSTMAX   1048576 // largest constant pool
 #define BEGINCODE  3
 #define INPUTADR   5
 #define OUTPUTADR  6
 #define PRDADR     7
 #define PRRADR     8
-#define DUMINST    62
+#define DUMINST    65
+#define DISPLAYMAX 16      // static levels held in the display
+#define VMFAULT    254     // status of an access outside the store (checked, or caught in its guards)
+#define HEAPLISTS  16      // free lists of the heap, one per block size below HEAPLISTS (p4_heap)
 
-typedef long settype[3];
+// the constant pool (reals, sets, bounds and strings of the program) follows the variable store (0..maxstk) of the vm
+#define OVERC(vm)  ((vm)->maxstk + (vm)->consts)
+#define MAXSTR(vm) (OVERC(vm) + 1) // cells of the store, also nil
+
+// largest variable store, the byte addresses of its chars (CHARADR) are int32
+#define MAXSTK     (INT32_MAX / CHARCELL - CONSTMAX - 1)
+
+// bytes of PROT_NONE before a vm made by p4_vm_new, whole pages (p4_clone)
+#define P4_VM_GUARD ((size_t) 1 << 16)
+
+// bytes of a vm with a variable store of maxstk cells and a constant pool of consts cells
+#define P4_VM_SIZE(maxstk, consts) (sizeof(struct p4_vm_s) + ((maxstk) + 1 + (consts)) * sizeof(rec_store_t))
+
+// P4_VM_SIZE in whole guards, the room of a vm: a vm with its memory file grows up to CONSTMAX, a clone does not grow
+#define P4_VM_ROOM(maxstk, consts) ((P4_VM_SIZE(maxstk, consts) + P4_VM_GUARD - 1) & ~(P4_VM_GUARD - 1))
+
+// end of the reservation of a vm made by p4_vm_new, in bytes from its start: twice its room
+#define P4_VM_REACH(vm) (2 * P4_VM_ROOM((vm)->maxstk, ((vm)->fd >= 0) ? CONSTMAX : (vm)->consts))
+
+// n cells from cell ad, n chars from byte address ad, lie in the store
+#define INSTORE(vm, ad, n) ((uint64_t) (uint32_t) (ad) + (uint32_t) (n) <= (uint64_t) MAXSTR(vm))
+#define INCHARS(vm, ad, n) ((uint64_t) (uint32_t) (ad) + (uint32_t) (n) <= (uint64_t) MAXSTR(vm) * CHARCELL)
+
+// opcodes only present in insn[]
+// fused instructions (built by the assembler from the sequences below)
+#define OP_INCL    110 // lodi p q; inci/deci k | ldci k, adi/sbi; stri p q
+#define OP_INCO    111 // ldoi q; inci/deci k | ldci k, adi/sbi; sroi q
+#define OP_IXAD    112 // lda 0 a | lao a; lodi 0 x | ldoi x; [chki]; [deci lb]; ixa s
+#define OP_IXLD    113 // OP_IXAD followed by ind k
+#define OP_CMPJ    114 // equi..lesi; fjp (one opcode per comparison)
+#define OP_VARJ    120 // lodi 0 a | ldoi a; lodi 0 b | ldoi b; equi..lesi; fjp
+#define OP_CONJ    126 // lodi 0 a | ldoi a; ldci k; equi..lesi; fjp
+
+// equ..les expanded by operand type: OP_RELOP + 7 * (op - 17) + p, p = a i r b s m c
+#define OP_RELOP   132
+#define OP_LAST    173
+
+// selection of fused sequences (p4_vm_s.fuse)
+#define FUSE_INC   0x01
+#define FUSE_IXA   0x02
+#define FUSE_CMPJ  0x04
+#define FUSE_ALL   (FUSE_INC | FUSE_IXA | FUSE_CMPJ)
+
+#define SETMAX     64      // elements of a set (0..SETMAX-1), the compiler allows 0..47
+#define CHARCELL   8       // chars of an array of char packed in a cell
+
+// byte address of char i of an array of char at cell ad (ixb), for ldb, stb and csp rdb
+#define CHARADR(ad, i) ((ad) * CHARCELL + (i))
+#define CHARS(vm)      ((uint8_t*) (vm)->store)
+
+typedef uint64_t setbits_t; // bit n holds element n
 
 typedef struct rec_code_s {
     uint8_t op1 :7;
     uint8_t p1  :4;
-    int16_t q1  :16;
+    int32_t q1;
     uint8_t op2 :7;
     uint8_t p2  :4;
-    int16_t q2;
+    int32_t q2;
 } rec_code_t;
 
-// store access
+// predecoded instruction, one per program address
+// a fused instruction covers w addresses; the covered records are never executed and may hold extra operands
+typedef struct rec_insn_s {
+    uint16_t op;
+    uint16_t w;
+     int32_t p;
+     int32_t q;
+     int32_t r; // third operand of fused instructions
+} __attribute__((aligned(16))) rec_insn_t;
+
+// mark stack link: sl cell holds the level of the frame, dl cell the display entry it replaced
+typedef struct rec_link_s {
+    int32_t ad; // address in store
+    int32_t lv;
+} rec_link_t;
+
+// store access, every cell is 8 bytes
 typedef union rec_store_s {
     int32_t vi;
      double vr;
        bool vb;
-    settype vs;
+  setbits_t vs;
     int16_t vc;
-    int16_t va;
+    int32_t va;
     int32_t vm; // address in store
+ rec_link_t vl;
 } rec_store_t;
 
+_Static_assert(sizeof(rec_store_t) == CHARCELL, "a cell holds CHARCELL chars");
+_Static_assert(HEAPLISTS >= 15, "a level p out of the display (p < 16) reads heap[], addresses in the store");
+
+// program loaded by p4_assembler, shared by a vm and its clones and read only once cloned (p4_clone)
+typedef struct p4_image_s {
+       uint32_t refs; // vms running the image
+       uint32_t size; // instructions code and insn hold
+     rec_code_t *code; // (size + 1) / 2 records, insn follows them in the same block
+     rec_insn_t *insn; // code expanded by p4_vm_decode
+} *p4_image_t;
+
 typedef struct p4_vm_s {
-     rec_code_t code[CODEMAX + 1];
+     rec_code_t *code;   // code of the image
+     rec_insn_t *insn;   // insn of the image
+     p4_image_t image;   // program of the vm, made by p4_vm_new
+       uint32_t codelen; // number of assembled instructions
+       uint32_t fuse;    // FUSE_* sequences the assembler may fuse
+           bool gc;      // new collects the unreachable blocks when the heap is full (p4_heap)
        uint32_t pc;      // program address register
            bool run;
-        int16_t mp;      // points to beginning of a data segment
-        int16_t sp;      // points to top of the stack
-        int16_t np;      // points to the maximum extent of the stack
-        int16_t ep;      // points to top of the dynamically allocated area
+        int32_t mp;      // points to beginning of a data segment
+        int32_t sp;      // points to top of the stack
+        int32_t np;      // points to the maximum extent of the stack
+        int32_t ep;      // points to top of the dynamically allocated area
+        int16_t lv;      // static level of the running procedure
+        int32_t maxstk;  // size of variable store, set by p4_vm_new
+        int32_t consts;  // cells of the constant pool, set by p4_vm_new and p4_vm_grow
+        int32_t heap[HEAPLISTS]; // first free block of each size, heap[0] the larger ones, 0 if none
+        int32_t display[DISPLAYMAX]; // data segment of the innermost active procedure at each level
+        int32_t gcleft;  // cells new takes before the next collection (p4_heap)
          file_t prd, prr; // prd for read only, prr for write only
-    rec_store_t store[OVERM + 1];
+         file_t input, output; // standard files of the program (stdin, stdout)
+struct p4_jit_s *jit;     // native code (p4_jit), NULL to only interpret
+        int32_t fd;      // memory file of a vm made by p4_vm_new (p4_clone), -1 otherwise
+    rec_store_t store[];  // MAXSTR(vm) cells
 } *p4_vm_t;
 
 uint8_t p4_vm_interpret(p4_vm_t p4vm);
+uint8_t p4_vm_run(p4_vm_t p4vm);
+uint8_t p4_vm_callsp(p4_vm_t p4vm, int32_t q, uint8_t op); // standard procedure q on the stack at sp, 255, op or VMFAULT
+   void p4_vm_decode(p4_vm_t p4vm);
+int32_t p4_heap_new(p4_vm_t p4vm, int32_t size);   // address of size new cells, 0 if there is no room, -1 if the heap is broken
+   bool p4_heap_dispose(p4_vm_t p4vm, int32_t ad); // false if ad is not an allocated block
+   bool p4_heap_release(p4_vm_t p4vm, int32_t np); // blocks below np (from sav) are released, false if the heap is broken
+p4_vm_t p4_vm_new(int32_t maxstk);
+   bool p4_vm_grow(p4_vm_t p4vm, int32_t consts); // constant pool of at least consts cells, false if there is no room
+   bool p4_vm_reserve(p4_vm_t p4vm, uint32_t len); // image of at least len instructions, false if there is no room
+p4_vm_t p4_vm_clone(p4_vm_t p4vm); // copy on write of a loaded vm made by p4_vm_new
+   void p4_vm_free(p4_vm_t p4vm);   // vm made by p4_vm_new or p4_vm_clone
 
 #endif /* P4_VM_H_ */
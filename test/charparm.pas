@@ -0,0 +1,26 @@
+program CharParm(Output);
+
+(* An element of an unpacked array of char is a variable of its own and
+may be passed as a var parameter; a packed array holds a string. *)
+
+var
+    Digits: array[1..5] of char;
+    Name: packed array[1..5] of char;
+    I: Integer;
+
+procedure SetChar(var C: char; D: char);
+begin
+    C := D
+end;
+
+begin
+    for I := 1 to 5 do
+        Digits[I] := '0';
+    SetChar(Digits[2], '7');
+    SetChar(Digits[5], '9');
+    for I := 1 to 5 do
+        Write(Digits[I]);
+    Writeln;
+    Name := 'HELLO';
+    Writeln(Name)
+end.
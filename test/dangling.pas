@@ -0,0 +1,28 @@
+program Dangling(Output);
+
+(* Writing through a disposed pointer overwrites the free list link of its
+block (R keeps it off the top of the heap): the second new finds the broken
+link and the run stops with "ERROR: access outside the store" after printing
+reused, instead of crashing; with -g too. *)
+
+type
+    Link = ^Node;
+    Node = record
+        Value: Integer;
+        Next: Link
+    end;
+
+var
+    P, Q, R: Link;
+
+begin
+    New(P);
+    New(R);
+    P^.Value := 1;
+    Dispose(P);
+    P^.Value := 123456789;
+    New(Q);
+    Writeln('reused');
+    New(Q);
+    Writeln('not reached')
+end.
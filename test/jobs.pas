@@ -0,0 +1,64 @@
+program Jobs(Output);
+
+(* Several runs at once through the executor: compile this to jobs.asm and
+run it next to other images, e.g. -x 4 jobs.asm helloworld.asm jobs.asm
+jobs.asm jobs.asm; every jobs.asm job prints 1229, 5736396, 500500 and 6765,
+the hello job its line, in the order of the files. Built with
+-fsanitize=thread the same run reports no race. *)
+
+const
+    Top = 10000;
+
+type
+    Link = ^Node;
+    Node = record
+        Value: Integer;
+        Next: Link
+    end;
+
+var
+    Sieve: array [2..Top] of Integer;
+    I, J, Count, Sum: Integer;
+    Head, P: Link;
+
+function Fib(N: Integer): Integer;
+begin
+    if N < 2 then
+        Fib := N
+    else
+        Fib := Fib(N - 1) + Fib(N - 2)
+end;
+
+begin
+    for I := 2 to Top do
+        Sieve[I] := 1;
+    Count := 0;
+    Sum := 0;
+    for I := 2 to Top do
+        if Sieve[I] = 1 then begin
+            Count := Count + 1;
+            Sum := Sum + I;
+            J := I + I;
+            while J <= Top do begin
+                Sieve[J] := 0;
+                J := J + I
+            end
+        end;
+    Writeln(Count);
+    Writeln(Sum);
+    Head := nil;
+    for I := 1 to 1000 do begin
+        New(P);
+        P^.Value := I;
+        P^.Next := Head;
+        Head := P
+    end;
+    Sum := 0;
+    P := Head;
+    while P <> nil do begin
+        Sum := Sum + P^.Value;
+        P := P^.Next
+    end;
+    Writeln(Sum);
+    Writeln(Fib(20))
+end.
@@ -39,9 +39,142 @@
 
 #include "p4_compiler.h"
 #include "p4_assembler.h"
+#include "p4_binary.h"
 #include "p4_internal.h"
 #include "p4_vm.h"
+#include "p4_jit.h"
+#include "p4_aot.h"
 #include "p4_file.h"
+#include "p4_exec.h"
+
+// assembles (or loads) prd.name and writes, translates or runs it; the assembler fails back here through _JL1
+static void execute(p4_vm_t p4vm, uint8_t jit, const char *aot, const char *bin) {
+    size_t len = strlen(p4vm->prd.name);
+    uint8_t err;
+
+    if (setjmp(_JL1))
+        return;
+
+    sprintf(p4vm->prr.name, "%s.p4", p4vm->prd.name);
+    printf("execute: %s (output: %s)\n", p4vm->prd.name, p4vm->prr.name);
+    if (*p4vm->prr.name != '\0') {
+        if (p4vm->prr.f != NULL)
+            p4vm->prr.f = freopen(p4vm->prr.name, "w", p4vm->prr.f);
+        else
+            p4vm->prr.f = fopen(p4vm->prr.name, "w");
+    } else {
+        if (p4vm->prr.f != NULL)
+            rewind(p4vm->prr.f);
+        else
+            p4vm->prr.f = tmpfile();
+    }
+    if (p4vm->prr.f == NULL)
+        _EscIO(FileNotFound);
+    p4vm->prr.f_BFLAGS = 0;
+    p4vm->fuse = FUSE_ALL;
+    if (len > 4 && strcmp(p4vm->prd.name + len - 4, ".p4b") == 0) {
+        if (!p4_binary_load(p4vm)) {
+            printf("ERROR: %s is not a valid image\n", p4vm->prd.name);
+            return;
+        }
+    } else if (!p4_assembler(p4vm)) { // assembles and stores code
+        printf("\n");
+        return;
+    }
+
+    if (bin != NULL) {
+        if (!p4_binary_write(p4vm, bin))
+            printf("ERROR: cannot write %s\n", bin);
+        return;
+    }
+
+    if (aot != NULL) {
+        if (!p4_aot(p4vm, aot))
+            printf("ERROR: cannot translate to %s\n", aot);
+        return;
+    }
+
+    if (jit && !p4_jit_init(p4vm, jit))
+        printf("jit not available, interpreting\n");
+
+    p4vm->pc = 0;
+    p4vm->sp = -1;
+    p4vm->mp = 0;
+    p4vm->np = p4vm->maxstk + 1;
+    p4vm->ep = 5;
+    p4vm->lv = 0;
+    p4vm->display[0] = 0;
+
+    p4vm->store[INPUTADR].vc = ' ';
+    p4vm->store[PRDADR].vc = p4_file_peek(p4vm->prd.f);
+    p4vm->run = true;
+
+    if ((err = p4_vm_run(p4vm)) == VMFAULT)
+        printf("ERROR: access outside the store\n");
+    else if (err != 255)
+        printf("ERROR op: %d\n", err);
+} // execute
+
+// runs every file as a job on workers threads, then prints the output of each job in order
+static void batch(uint32_t workers, int32_t maxstk, int n, char *name[]) {
+    p4_exec_t ex;
+    p4_vm_t *image;
+    p4_job_t *job;
+    char (*out)[80];
+    FILE *f;
+    int k, i, c;
+
+    image = calloc(n, sizeof(p4_vm_t));
+    job = calloc(n, sizeof(p4_job_t));
+    out = calloc(n, sizeof(*out));
+    if (image == NULL || job == NULL || out == NULL || (ex = p4_exec_new(workers)) == NULL) {
+        printf("ERROR: cannot start %u workers\n", workers);
+        goto done;
+    }
+
+    // a file named twice is loaded once, its jobs share the image
+    for (k = 0; k < n; k++) {
+        for (i = 0; i < k && strcmp(name[i], name[k]) != 0; i++)
+            ;
+        if (i < k)
+            job[k].image = image[i];
+        else if ((job[k].image = image[k] = p4_exec_load(name[k], maxstk)) == NULL) {
+            printf("ERROR: cannot load %s\n", name[k]);
+            goto stop;
+        }
+        snprintf(out[k], sizeof(out[k]), "%s.%d.out", name[k], k);
+        job[k].input = NULL;
+        job[k].output = out[k];
+    }
+
+    for (k = 0; k < n; k++)
+        if (!p4_exec_submit(ex, &job[k]))
+            printf("ERROR: cannot queue %s\n", name[k]);
+    p4_exec_wait(ex);
+
+    for (k = 0; k < n; k++) {
+        printf("job %d: %s\n", k, name[k]);
+        if ((f = fopen(out[k], "r")) != NULL) {
+            while ((c = fgetc(f)) != EOF)
+                putchar(c);
+            fclose(f);
+        }
+        if (job[k].status == VMFAULT)
+            printf("ERROR: access outside the store\n");
+        else if (job[k].status != 255)
+            printf("ERROR op: %d\n", job[k].status);
+    }
+
+stop:
+    p4_exec_free(ex);
+done:
+    for (k = 0; image != NULL && k < n; k++)
+        if (image[k] != NULL)
+            p4_vm_free(image[k]);
+    free(image);
+    free(job);
+    free(out);
+} // batch
 
 int main(int argc, char *argv[]) {
     if (argc == 1 || strcmp(argv[1], "-h") == 0) {
@@ -51,7 +184,18 @@ int main(int argc, char *argv[]) {
         printf("        fileinput fileoutput\n");
         printf("\n");
         printf("else interpreter:\n");
-        printf("        asmfileinput\n");
+        printf("        [-j] [-t] [-g] [-s cells] asmfileinput | p4bfileinput\n");
+        printf("    -j: compile procedures to native code (x86-64)\n");
+        printf("    -t: compile hot loops to native code as traces (x86-64)\n");
+        printf("    -g: collect unreachable heap blocks when the heap is full\n");
+        printf("    -s: size of the variable store (default %d, an image keeps its own)\n", STOREMAX);
+        printf("\n");
+        printf("    -aot: translate to C\n");
+        printf("        [-s cells] asmfileinput fileoutput\n");
+        printf("    -b: write a binary image (.p4b), it runs with the -s it was written with\n");
+        printf("        [-s cells] asmfileinput fileoutput\n");
+        printf("    -x: run each file as a job on a pool of worker threads, then print the outputs in order\n");
+        printf("        [-s cells] workers asmfileinput | p4bfileinput ...\n");
         exit(0);
     }
 
@@ -65,61 +209,87 @@ int main(int argc, char *argv[]) {
         exit(0);
     }
 
-    p4_vm_t p4vm = malloc(sizeof(struct p4_vm_s));
-    uint8_t err;
+    p4_vm_t p4vm;
+    uint8_t jit = 0;
+    bool gc = false;
+    int32_t maxstk = 0, image;
+    uint32_t workers = 0;
+    char *aot = NULL;
+    char *bin = NULL;
+    size_t len;
 
-    printf("- intepreter -\n");
+    for (;;) {
+        if (argc > 2 && (strcmp(argv[1], "-j") == 0 || strcmp(argv[1], "-t") == 0)) {
+            jit |= (argv[1][1] == 'j') ? JIT_METHOD : JIT_TRACE;
+            argv++;
+            argc--;
+        } else if (argc > 2 && strcmp(argv[1], "-g") == 0) {
+            gc = true;
+            argv++;
+            argc--;
+        } else if (argc > 3 && strcmp(argv[1], "-s") == 0) {
+            maxstk = atol(argv[2]);
+            argv += 2;
+            argc -= 2;
+        } else if (argc > 3 && strcmp(argv[1], "-aot") == 0) {
+            aot = argv[--argc];
+            argv++;
+            argc--;
+        } else if (argc > 3 && strcmp(argv[1], "-x") == 0) {
+            workers = atol(argv[2]);
+            argv += 2;
+            argc -= 2;
+        } else if (argc > 3 && strcmp(argv[1], "-b") == 0) {
+            bin = argv[--argc];
+            argv++;
+            argc--;
+        } else
+            break;
+    }
 
-    if (setjmp(_JL1))
-        goto _L1;
-
-    prr.f = NULL;
-    prd.f = NULL;
-    strcpy(prd.name, argv[1]);
-    sprintf(prr.name, "%s.p4", prd.name);
-    printf("execute: %s (output: %s)\n", prd.name, prr.name);
-    if (*prr.name != '\0') {
-        if (prr.f != NULL)
-            prr.f = freopen(prr.name, "w", prr.f);
-        else
-            prr.f = fopen(prr.name, "w");
-    } else {
-        if (prr.f != NULL)
-            rewind(prr.f);
-        else
-            prr.f = tmpfile();
+    if (workers > 0) {
+        printf("- executor -\n");
+        batch(workers, (maxstk != 0) ? maxstk : STOREMAX, argc - 1, argv + 1);
+        return 0;
     }
-    if (prr.f == NULL)
-        _EscIO(FileNotFound);
-    prr.f_BFLAGS = 0;
-    p4_assembler(p4vm); // assembles and stores code
 
-    p4vm->pc = 0;
-    p4vm->sp = -1;
-    p4vm->mp = 0;
-    p4vm->np = MAXSTK + 1;
-    p4vm->ep = 5;
+    // the constants of an image are placed above the store it was written for
+    len = strlen(argv[1]);
+    if (len > 4 && strcmp(argv[1] + len - 4, ".p4b") == 0) {
+        if ((image = p4_binary_maxstk(argv[1])) < 0) {
+            printf("ERROR: %s is not a .p4b image\n", argv[1]);
+            exit(1);
+        }
+        if (maxstk != 0 && maxstk != image) {
+            printf("ERROR: %s is an image for a store of %d cells, not %d\n", argv[1], image, maxstk);
+            exit(1);
+        }
+        maxstk = image;
+    } else if (maxstk == 0)
+        maxstk = STOREMAX;
 
-    p4vm->prr = prr;
-    p4vm->prd = prd;
+    if (maxstk < PRRADR + 1 || (p4vm = p4_vm_new(maxstk)) == NULL) {
+        printf("ERROR: cannot allocate a store of %d cells\n", maxstk);
+        exit(1);
+    }
 
-    p4vm->store[INPUTADR].vc = ' ';
-    p4vm->store[PRDADR].vc = p4_file_peek(prd.f);
-    p4vm->run = true;
+    printf(aot ? "- translator -\n" : bin ? "- assembler -\n" : "- intepreter -\n");
 
-    while (p4vm->run) {
-        if ((err = p4_vm_interpret(p4vm)) != 255) {
-            printf("ERROR op: %d\n", err);
-            break;
-        }
-    } // while interpreting
+    p4vm->jit = NULL;
+    p4vm->prr.f = NULL;
+    p4vm->prd.f = NULL;
+    p4vm->input.f = stdin;
+    p4vm->output.f = stdout;
+    p4vm->gc = gc;
+    strcpy(p4vm->prd.name, argv[1]);
+    execute(p4vm, jit, aot, bin);
 
-    _L1:
-    if (prd.f != NULL)
-        fclose(prd.f);
-    if (prr.f != NULL)
-        fclose(prr.f);
+    if (p4vm->prd.f != NULL)
+        fclose(p4vm->prd.f);
+    if (p4vm->prr.f != NULL)
+        fclose(p4vm->prr.f);
 
-    free(p4vm);
+    p4_jit_free(p4vm);
+    p4_vm_free(p4vm);
     return 0;
 }
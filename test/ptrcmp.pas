@@ -0,0 +1,50 @@
+program PtrCmp(Output);
+
+(* Pointers compared above address 65535: run with a store of 200000 cells
+(-s 200000) in the interpreter and with -j, -t; every run prints 40000 twice
+and 20000. *)
+
+type
+    Link = ^Node;
+    Node = record
+        Value: Integer;
+        Next: Link
+    end;
+
+var
+    Head, P, Mid: Link;
+    I, Count, Found: Integer;
+
+begin
+    Head := nil;
+    for I := 1 to 40000 do begin
+        New(P);
+        P^.Value := I;
+        P^.Next := Head;
+        Head := P;
+        if I = 20000 then
+            Mid := P
+    end;
+    Count := 0;
+    P := Head;
+    while P <> nil do begin
+        Count := Count + 1;
+        P := P^.Next
+    end;
+    Writeln(Count);
+    Count := 0;
+    P := Head;
+    repeat
+        Count := Count + 1;
+        P := P^.Next
+    until P = nil;
+    Writeln(Count);
+    Found := 0;
+    P := Head;
+    while P <> nil do begin
+        if P = Mid then
+            Found := P^.Value;
+        P := P^.Next
+    end;
+    Writeln(Found)
+end.